@@ -0,0 +1,698 @@
+/* bench.c
+ *
+ * Read path benchmark. For every file system
+ * configuration (FAT sub type, cluster size,
+ * fragmentation) a disk image is generated, then
+ * - a file is read with pf_read() by READ_CHUNK
+ *   bytes, giving the throughput allowed by the
+ *   bus time of the SPI cost model,
+ * - every file is played with load_header() and
+ *   playback(), giving the worst refill latency
+ *   and the number of samples which differ from
+ *   the file content (underruns),
+ * - the directory is played back to back with
+ *   playback_stream(), the files being opened while
+ *   the previous one drains : the worst refill
+ *   latency includes the switch, a gap shows up as
+ *   differing samples.
+ * Every layout is then read from random positions
+ * reached by pf_lseek(), without and with a cluster
+ * link map, then by pf_readsect() mixed with the
+ * other read calls, the data being checked.
+ * Then a few configurations are played at every
+ * supported sample rate, from 8 and 16-bit, mono
+ * and stereo files, from IMA ADPCM files and from
+ * G.711 files,
+ * giving the CPU load of the refills and the sample
+ * interrupt, and the rate at which the CPU would be
+ * fully loaded.
+ * IMA ADPCM files whose data don't start on a sector
+ * are played from every fragmented layout, their block
+ * headers being read across the sector ends.
+ * Last, the bus time taken to open the last track of
+ * a large directory by its path and header, and
+ * through the playlist index, is measured, as well
+ * as the time to walk the directory and open every
+ * track by its path or from its directory item.
+ * The bus time of pf_open() and load_header() is
+ * also given for a single contiguous file of
+ * growing size, the chain walk done at open being
+ * bounded.
+ *
+ * The files hold SAMPLES samples by default, a long
+ * track : the cluster chain is followed while it is
+ * played and while the next one is opened. The rate
+ * sweep plays shorter files, SWEEP_SAMPLES at most.
+ *
+ * usage : bench [-d directory for the image] [-s samples per file] [-r sample frequency]
+ *               [-i sample interrupt cycles] [-m metadata chunk size] [-b 4|8|16] [-C 1|2]
+ *               [-g 6|7 (G.711 A-law|mu-law)]
+ */
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "pff.h"
+#include "playwaveutils.h"
+#include "hostdisk.h"
+#include "fatimg.h"
+
+#define NFILES      2
+#define SAMPLES     2000000 /* default samples per file, 45 s at 44.1 kHz */
+#define SWEEP_SAMPLES 200000 /* samples per file of the rate sweep */
+#define OPEN_FILES  99      /* files of the open pass */
+#define OPEN_SAMPLES 2048
+#define READ_CHUNK  128     /* pf_read() size of the throughput pass */
+#define SEEKS       2000    /* random seeks of the seek pass */
+#define SEEK_READ   600     /* max bytes read after a seek, sectors are crossed */
+
+FATFS fs;
+DIR dir;
+FILINFO fno;
+
+static const struct {
+    uint8_t fat_type;
+    uint8_t csize;
+    uint16_t frag;
+} configs[] = {
+    {16, 1, 0}, {16, 1, 8}, {16, 1, 1},
+    {16, 4, 0}, {16, 4, 8}, {16, 4, 1},
+    {16, 16, 0}, {16, 16, 8}, {16, 16, 1},
+    {16, 64, 0}, {16, 64, 8}, {16, 64, 1},
+    {32, 1, 0}, {32, 1, 8}, {32, 1, 1},
+    {32, 4, 0}, {32, 4, 8}, {32, 4, 1},
+    {32, 16, 0}, {32, 16, 8}, {32, 16, 1},
+    {32, 64, 0}, {32, 64, 8}, {32, 64, 1},
+    {16, 1, 200},   /* first fragment longer than the walk at open */
+};
+
+/* open cost : contiguous files of growing size */
+static const struct {
+    uint8_t fat_type;
+    uint8_t csize;
+    uint32_t kbytes;
+} opencost[] = {
+    {16, 1, 64}, {16, 1, 1024}, {16, 1, 8192}, {16, 1, 30720},
+    {32, 1, 64}, {32, 1, 1024}, {32, 1, 8192}, {32, 1, 30720},
+    {32, 8, 64}, {32, 8, 1024}, {32, 8, 8192}, {32, 8, 30720},
+};
+
+/* metadata chunk sizes leaving the ADPCM blocks across the sector ends */
+static const uint16_t metas[] = {196, 452};
+
+/* rate sweep : best, fragmented and worst layouts */
+static const uint32_t rates[] = {8000, 11025, 16000, 22050, 32000, 44100};
+static const uint8_t sweep[] = {21, 4, 14};
+static const struct {
+    uint8_t bits;
+    uint8_t channels;
+    uint8_t g711;
+} formats[] = {{8, 1, 0}, {16, 1, 0}, {8, 2, 0}, {16, 2, 0}, {4, 1, 0}, {8, 1, 7}, {8, 1, 6}};
+
+static uint8_t* played;
+static uint32_t nplayed, maxplayed;
+static uint8_t tolerance;           /* difference allowed between played and expected samples */
+static uint8_t* expected;           /* file content, as played */
+
+static void record_sample(uint8_t sample)
+{
+    if(nplayed < maxplayed) played[nplayed] = sample;
+    nplayed++;
+}
+
+/* store the samples of a file, as they should be played, from
+ * expected[n], the number of samples is returned */
+static uint32_t expect(uint8_t file, const FATIMG* conf, uint32_t n)
+{
+    uint32_t i;
+
+    if(conf->bits == 4) return fatimg_adpcm_ref(file, conf, expected + n, maxplayed - n);
+    for(i = 0; i < conf->nsamples && n + i < maxplayed; i++)
+        expected[n + i] = conf->g711 ? fatimg_g711_sample(file, i, conf->g711) : fatimg_sample(file, i);
+    return conf->nsamples;
+}
+
+/* number of played samples which don't match the first n expected ones,
+ * plus the expected samples left unplayed */
+static uint32_t check_samples(uint32_t n)
+{
+    uint32_t i, err;
+
+    if(nplayed > maxplayed || n > maxplayed) return nplayed;
+    for(err = 0, i = 0; i < nplayed; i++)
+        if(i >= n || abs((int)played[i] - (int)expected[i]) > tolerance) err++;
+    if(nplayed < n) err += n - nplayed;
+    return err;
+}
+
+/* read a whole file by READ_CHUNK bytes */
+static int bench_read(double* kbps, double* sps, double* cmds, double* toks)
+{
+    static uint8_t buf[READ_CHUNK];
+    DISK_STATS start = host_disk;
+    UINT br;
+    uint32_t total = 0;
+    double s, mb;
+
+    if(pf_open("WAV/TRACK00.WAV") != FR_OK) return 1;
+    do
+    {
+        if(pf_read(buf, sizeof(buf), &br) != FR_OK) return 1;
+        total += br;
+    }while(br == sizeof(buf));
+
+    s = (double)(host_disk.cycles - start.cycles) / F_CPU;
+    mb = total / 1048576.0;
+    *kbps = total / s / 1000.0;
+    *sps = total / 512.0 / s;
+    *cmds = (host_disk.commands - start.commands) / mb;
+    *toks = (host_disk.tokens - start.tokens) / mb;
+    return 0;
+}
+
+/* play every file of the WAV directory, the load is the part of the
+ * CPU time taken by the bus transfers, the sample conversions and
+ * the sample interrupt */
+static int bench_play(const FATIMG* conf, double* refill, uint32_t* errors, double* load)
+{
+    char path[23];
+    uint8_t f;
+    uint64_t start = host_cycles, bus = host_disk.cycles, work = host_work_cycles;
+    uint64_t ticks = 0;
+
+    host_busy_max = 0;
+    *errors = 0;
+    for(f = 0; f < NFILES; f++)
+    {
+        snprintf(path, sizeof(path), "WAV/TRACK%02u.WAV", (unsigned)f);
+        if(pf_open(path) != FR_OK || load_header() < 1024) return 1;
+        nplayed = 0;
+        if(playback()) return 1;
+        *errors += check_samples(expect(f, conf, 0));
+        ticks += nplayed;
+    }
+    *refill = host_busy_max * 1e6 / F_CPU;
+    *load = (double)(host_disk.cycles - bus + host_work_cycles - work + ticks * host_isr_cycles) * 100.0
+        / (double)(host_cycles - start);
+    return 0;
+}
+
+/* play the WAV directory back to back, as main() does,
+ * the health counters of the whole stream are stored to h */
+static int bench_gapless(const FATIMG* conf, double* refill, uint32_t* errors, PLAYHEALTH* h)
+{
+    uint32_t n = 0;
+    uint8_t f = 0;
+
+    host_busy_max = 0;
+    nplayed = 0;
+    playback_health(h, 1);
+    if(pf_opendir(&dir, "WAV") != FR_OK) return 1;
+    for(;;)
+    {
+        if(pf_readdir(&dir, &fno) != FR_OK) return 1;
+        if(!fno.fname[0]) break;
+        if(fno.fattrib & AM_DIR) continue;
+
+        if(pf_openentry(&fno) != FR_OK || load_header() < 1024 || playback_stream()) return 1;
+        n += expect(f++, conf, n);
+    }
+    playback_end();
+    playback_health(h, 1);
+    *errors = check_samples(n);
+    *refill = host_busy_max * 1e6 / F_CPU;
+    return 0;
+}
+
+/* open the last file by its path and its header, then through the index,
+ * and play it, in us of bus time */
+static int bench_open(const FATIMG* conf, double* by_path, double* by_index, uint32_t* errors)
+{
+    char path[23];
+    uint8_t f = (uint8_t)(conf->nfiles - 1);
+    uint64_t start;
+
+    snprintf(path, sizeof(path), "WAV/TRACK%02u.WAV", (unsigned)f);
+    start = host_disk.cycles;
+    if(pf_open(path) != FR_OK || load_header() < 1024) return 1;
+    *by_path = (double)(host_disk.cycles - start) * 1e6 / F_CPU;
+
+    if(index_open() != conf->nfiles) return 1;
+    start = host_disk.cycles;
+    if(index_load(f, NULL) < 1024) return 1;
+    *by_index = (double)(host_disk.cycles - start) * 1e6 / F_CPU;
+
+    nplayed = 0;
+    if(playback()) return 1;
+    *errors = check_samples(expect(f, conf, 0));
+    return 0;
+}
+
+/* walk the WAV directory and open every file, by its path or from
+ * its directory item, and load its header, in ms of bus time */
+static int bench_walk(uint8_t by_entry, double* ms)
+{
+    char path[23];
+    uint64_t start = host_disk.cycles;
+
+    if(pf_opendir(&dir, "WAV") != FR_OK) return 1;
+    for(;;)
+    {
+        if(pf_readdir(&dir, &fno) != FR_OK) return 1;
+        if(!fno.fname[0]) break;
+        if(fno.fattrib & AM_DIR) continue;
+
+        snprintf(path, sizeof(path), "WAV/%s", fno.fname);
+        if((by_entry ? pf_openentry(&fno) : pf_open(path)) != FR_OK || load_header() < 1024) return 1;
+    }
+    *ms = (double)(host_disk.cycles - start) * 1e3 / F_CPU;
+    return 0;
+}
+
+/* seek to random positions of a 8-bit file and read from them, checking
+ * the data read against the generated content. With map, the seeks go
+ * through the cluster link map of the file. The disk reads per seek
+ * (pf_lseek() and pf_read()) and the bytes found wrong are stored */
+static int bench_seek(const FATIMG* conf, uint8_t map, double* reads, uint32_t* errors)
+{
+    static uint8_t buf[SEEK_READ];
+    static DWORD tbl0[8];
+    DWORD* tbl = tbl0;
+    uint32_t seed = 1, i, n, ofs, hdr = fatimg_header(conf), start;
+    UINT br;
+    FRESULT res;
+    int err = 0;
+
+    if(pf_open("WAV/TRACK00.WAV") != FR_OK) return 1;
+    if(map)
+    {
+        tbl0[0] = sizeof(tbl0) / sizeof(tbl0[0]);
+        res = pf_linkmap(tbl);
+        if(res == FR_NOT_ENOUGH_CORE)   /* fragmented file, allocate the size asked for */
+        {
+            n = tbl0[0];
+            if(!(tbl = malloc(n * sizeof(DWORD)))) return 1;
+            tbl[0] = n;
+            res = pf_linkmap(tbl);
+        }
+        if(res != FR_OK) err = 1;
+    }
+
+    start = host_disk.reads;
+    *errors = 0;
+    for(i = 0; i < SEEKS && !err; i++)
+    {
+        seed = seed * 1103515245U + 12345U;
+        ofs = (seed >> 8) % fs.fsize;
+        n = 1 + (seed >> 4) % SEEK_READ;
+        if(pf_lseek(ofs) != FR_OK || fs.fptr != ofs || pf_read(buf, (UINT)n, &br) != FR_OK)
+        {
+            err = 1;
+            break;
+        }
+        if(br != (ofs + n > fs.fsize ? fs.fsize - ofs : n)) (*errors)++;
+        for(n = 0; n < br; n++, ofs++)
+            if(ofs >= hdr && ofs - hdr < conf->nsamples && buf[n] != fatimg_sample(0, ofs - hdr)) (*errors)++;
+    }
+    *reads = (double)(host_disk.reads - start) / SEEKS;
+
+    if(tbl != tbl0) free(tbl);
+    return err;
+}
+
+/* number of bytes of buf, read from the file offset ofs, which differ
+ * from the content of a 8-bit file */
+static uint32_t check_read(const FATIMG* conf, const uint8_t* buf, uint32_t ofs, UINT n)
+{
+    uint32_t hdr = fatimg_header(conf), err = 0;
+    UINT i;
+
+    for(i = 0; i < n; i++, ofs++)
+        if(ofs >= hdr && ofs - hdr < conf->nsamples && buf[i] != fatimg_sample(0, ofs - hdr)) err++;
+    return err;
+}
+
+/* read a 8-bit file with pf_readsect() mixed with pf_read(), pf_lseek()
+ * and pf_readstart(), which must agree on the cluster of the file pointer.
+ * First a whole cluster is read by sectors then followed by a pf_read(),
+ * or by a pf_lseek() into the next cluster and a read, a first fragment
+ * longer than PF_CLUST_WALK clusters is read across its end after a seek
+ * past it, then the calls are mixed at random. The bytes found wrong are
+ * stored */
+static int bench_mixed(const FATIMG* conf, uint32_t* errors)
+{
+    static uint8_t buf[SEEK_READ];
+    uint32_t seed = 7, i, ofs, clust = conf->csize * 512U;
+    uint32_t frag = conf->frag * clust;
+    UINT n, br;
+    uint8_t s, op;
+
+    if(pf_open("WAV/TRACK00.WAV") != FR_OK) return 1;
+    *errors = 0;
+    for(op = 0; op < 2; op++)
+    {
+        if(pf_lseek(0) != FR_OK) return 1;
+        for(s = 0; s < conf->csize; s++)
+        {
+            if(pf_readsect(buf, 512, &br) != FR_OK) return 1;
+            *errors += check_read(conf, buf, fs.fptr - br, br);
+        }
+        if(op && pf_lseek(clust + 88) != FR_OK) return 1;
+        ofs = fs.fptr;
+        if(pf_read(buf, 512, &br) != FR_OK) return 1;
+        *errors += check_read(conf, buf, ofs, br);
+    }
+
+    /* a first fragment longer than the walk at open : seek past it, back
+     * into it, then read on across its end */
+    if(conf->frag > PF_CLUST_WALK && frag + 20 * clust < fs.fsize)
+    {
+        if(pf_lseek(frag + 20 * clust + 10) != FR_OK || pf_read(buf, 512, &br) != FR_OK) return 1;
+        *errors += check_read(conf, buf, frag + 20 * clust + 10, br);
+        if(pf_lseek(frag - 10 * clust + 10) != FR_OK) return 1;
+        for(i = 0; i < 40 * conf->csize; i++)
+        {
+            ofs = fs.fptr;
+            if(pf_read(buf, 512, &br) != FR_OK) return 1;
+            *errors += check_read(conf, buf, ofs, br);
+        }
+    }
+
+    for(i = 0; i < SEEKS; i++)
+    {
+        seed = seed * 1103515245U + 12345U;
+        n = 1 + (seed >> 4) % 512;
+        ofs = fs.fptr;
+        switch((seed >> 16) % 8)
+        {
+            case 0:     /* seek */
+                if(pf_lseek((seed >> 8) % fs.fsize) != FR_OK) return 1;
+                continue;
+            case 1:
+                if(pf_read(buf, n, &br) != FR_OK) return 1;
+                break;
+#if PF_USE_ASYNC
+            case 2:
+                if(pf_readstart(buf, n, &br) != FR_OK) return 1;
+                while(pf_readbusy());
+                break;
+#endif
+            default:    /* a stream of sectors */
+                if(pf_readsect(buf, n, &br) != FR_OK) return 1;
+                break;
+        }
+        *errors += check_read(conf, buf, ofs, br);
+        if(fs.fptr == fs.fsize && pf_lseek(0) != FR_OK) return 1;
+    }
+    return 0;
+}
+
+/* open the only file of the image by its path and its header, in us of
+ * bus time, then read it through to check its content */
+static int bench_opencost(const FATIMG* conf, double* us, uint8_t* contig, uint32_t* errors)
+{
+    static uint8_t buf[512];
+    uint64_t start = host_disk.cycles;
+    uint32_t i, n = 0, hdr = fatimg_header(conf);
+    UINT br;
+
+    if(pf_open("WAV/TRACK00.WAV") != FR_OK || load_header() < 1024) return 1;
+    *us = (double)(host_disk.cycles - start) * 1e6 / F_CPU;
+    *contig = (fs.flag & FA_CONTIG) != 0;
+
+    *errors = 0;
+    if(pf_lseek(0) != FR_OK) return 1;
+    do
+    {
+        if(pf_read(buf, sizeof(buf), &br) != FR_OK) return 1;
+        for(i = 0; i < br; i++, n++)
+            if(n >= hdr && n - hdr < conf->nsamples && buf[i] != fatimg_sample(0, n - hdr)) (*errors)++;
+    }while(br == sizeof(buf));
+    if(n != fs.fsize) return 1;
+    contig[1] = (fs.flag & FA_CONTIG) != 0;
+    return 0;
+}
+
+/* generate the image and play it */
+static int run_play(const char* image, const FATIMG* conf, double* refill, uint32_t* errors, double* load)
+{
+    int err;
+
+    tolerance = conf->bits == 16;
+    host_reset();
+    err = fatimg_create(image, conf) || host_disk_open(image) || pf_mount(&fs) != FR_OK
+        || bench_play(conf, refill, errors, load);
+    host_disk_close();
+    unlink(image);
+    return err;
+}
+
+int main(int argc, char* argv[])
+{
+    FATIMG conf = {16, 1, 0, NFILES, SAMPLES, SAMPLE_FREQ_MAX, 0, 8, 1, 0, 0};
+    const char* dname = "/tmp";
+    char image[256];
+    double kbps, sps, cmds, toks, refill, load, by_path, by_index, walk_path, walk_entry;
+    uint32_t errors;
+    PLAYHEALTH health;
+    unsigned i, r, b;
+    int opt, err = 0;
+
+    while((opt = getopt(argc, argv, "d:s:r:i:p:m:b:C:g:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'd': dname = optarg; break;
+            case 's': conf.nsamples = (uint32_t)atol(optarg); break;
+            case 'r': conf.freq = (uint32_t)atol(optarg); break;
+            case 'i': host_isr_cycles = (uint16_t)atoi(optarg); break;
+            case 'p': host_spi.stream_cycles = (uint16_t)atoi(optarg); break;
+            case 'm': conf.meta = (uint16_t)atoi(optarg); break;
+            case 'b': conf.bits = (uint8_t)atoi(optarg); break;
+            case 'C': conf.channels = (uint8_t)atoi(optarg); break;
+            case 'g': conf.g711 = (uint8_t)atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage : %s [-d directory] [-s samples per file] [-r sample frequency] [-i interrupt cycles] [-p receive loop cycles per byte] [-m metadata chunk size] [-b 4|8|16] [-C 1|2] [-g 6|7]\n", argv[0]);
+                return 2;
+        }
+    }
+    snprintf(image, sizeof(image), "%s/bench%d.img", dname, (int)getpid());
+
+    maxplayed = (conf.nsamples + 1) * NFILES;  /* ADPCM padding sample, files played back to back */
+    played = malloc(maxplayed);
+    expected = malloc(maxplayed);
+    if(!played || !expected) return 1;
+    host_sink = record_sample;
+
+    printf("SPI model : %u cycles/byte, %u in the receive loops, Ncr %u, Nac %u bytes, %u busy bytes, ISR %u cycles\n",
+        host_spi.byte_cycles, host_spi.stream_cycles, host_spi.ncr, host_spi.nac, host_spi.busy, host_isr_cycles);
+    printf("%u files of %lu %u-bit %s samples at %lu Hz, RING_SIZE %u, REFILL_MIN %u\n\n", NFILES,
+        (unsigned long)conf.nsamples, conf.bits, conf.bits == 4 ? "ADPCM" : conf.g711 == 7 ? "mu-law" : conf.g711 == 6 ? "A-law"
+        : conf.channels == 2 ? "stereo" : "mono",
+        (unsigned long)conf.freq, RING_SIZE, REFILL_MIN);
+    printf("FAT clust frag |    kB/s sectors/s  cmd/MB tok/MB | refill(us) errors | gapless refill(us) errors underruns stalls\n");
+
+    for(i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+    {
+        conf.fat_type = configs[i].fat_type;
+        conf.csize = configs[i].csize;
+        conf.frag = configs[i].frag;
+
+        printf(" %2u %5u %4u | ", conf.fat_type, conf.csize, conf.frag);
+        fflush(stdout);
+
+        tolerance = conf.bits == 16;
+        host_reset();
+        if(fatimg_create(image, &conf) || host_disk_open(image) || pf_mount(&fs) != FR_OK)
+        {
+            printf("can't create or mount the image\n");
+            err = 1;
+        }
+        else if(bench_read(&kbps, &sps, &cmds, &toks))
+        {
+            printf("read error\n");
+            err = 1;
+        }
+        else if(printf("%7.1f %9.1f %7.1f %6.1f | ", kbps, sps, cmds, toks),
+                bench_play(&conf, &refill, &errors, &load))
+        {
+            printf("playback error\n");
+            err = 1;
+        }
+        else if(printf("%10.1f %6lu | ", refill, (unsigned long)errors),
+                bench_gapless(&conf, &refill, &errors, &health))
+        {
+            printf("gapless playback error\n");
+            err = 1;
+        }
+        else
+        {
+            printf("%18.1f %6lu %9u %6u\n", refill, (unsigned long)errors, health.underruns, health.stalls);
+        }
+
+        host_disk_close();
+        unlink(image);
+    }
+
+    printf("\nrandom seek, %u seeks and reads up to %u bytes\n", SEEKS, SEEK_READ);
+    printf("FAT clust frag | reads/seek errors | linkmap reads/seek errors | mixed reads errors\n");
+    conf.bits = 8;
+    conf.channels = 1;
+    conf.g711 = 0;
+    for(i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+    {
+        double reads, reads_map;
+        uint32_t errors_map, errors_mixed;
+
+        conf.fat_type = configs[i].fat_type;
+        conf.csize = configs[i].csize;
+        conf.frag = configs[i].frag;
+        printf(" %2u %5u %4u | ", conf.fat_type, conf.csize, conf.frag);
+        fflush(stdout);
+
+        host_reset();
+        if(fatimg_create(image, &conf) || host_disk_open(image) || pf_mount(&fs) != FR_OK
+            || bench_seek(&conf, 0, &reads, &errors) || bench_seek(&conf, 1, &reads_map, &errors_map)
+            || bench_mixed(&conf, &errors_mixed))
+        {
+            printf("seek error\n");
+            err = 1;
+        }
+        else
+        {
+            printf("%10.1f %6lu | %18.1f %6lu | %19lu\n", reads, (unsigned long)errors, reads_map, (unsigned long)errors_map,
+                (unsigned long)errors_mixed);
+        }
+        host_disk_close();
+        unlink(image);
+    }
+
+    printf("\nrate sweep, %lu samples per file\n", (unsigned long)(conf.nsamples < SWEEP_SAMPLES ? conf.nsamples : SWEEP_SAMPLES));
+    if(conf.nsamples > SWEEP_SAMPLES) conf.nsamples = SWEEP_SAMPLES;
+    printf(" bits ch g711  rate | FAT clust frag | refill(us) load(%%) errors max(Hz)\n");
+    for(b = 0; b < sizeof(formats) / sizeof(formats[0]); b++)
+    {
+        for(r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+        {
+            for(i = 0; i < sizeof(sweep); i++)
+            {
+                conf.fat_type = configs[sweep[i]].fat_type;
+                conf.csize = configs[sweep[i]].csize;
+                conf.frag = configs[sweep[i]].frag;
+                conf.freq = rates[r];
+                conf.bits = formats[b].bits;
+                conf.channels = formats[b].channels;
+                conf.g711 = formats[b].g711;
+
+                printf("%5u %2u %4u %5lu | %3u %5u %4u | ", conf.bits, conf.channels, conf.g711, (unsigned long)conf.freq,
+                    conf.fat_type, conf.csize, conf.frag);
+                if(run_play(image, &conf, &refill, &errors, &load))
+                {
+                    printf("playback error\n");
+                    err = 1;
+                }
+                else
+                {
+                    printf("%10.1f %7.1f %6lu %7.0f\n", refill, load, (unsigned long)errors, conf.freq * 100.0 / load);
+                }
+            }
+        }
+    }
+
+    printf("\nADPCM, unaligned data, fragmented layouts%s\n", PF_USE_ASYNC ? ", background reads" : "");
+    printf(" meta | FAT clust frag | refill(us) load(%%) errors\n");
+    conf.bits = 4;
+    conf.channels = 1;
+    conf.g711 = 0;
+    conf.freq = SAMPLE_FREQ_MAX;
+    for(b = 0; b < sizeof(metas) / sizeof(metas[0]); b++)
+    {
+        for(i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+        {
+            if(!configs[i].frag) continue;
+            conf.fat_type = configs[i].fat_type;
+            conf.csize = configs[i].csize;
+            conf.frag = configs[i].frag;
+            conf.meta = metas[b];
+
+            printf(" %4u | %3u %5u %4u | ", conf.meta, conf.fat_type, conf.csize, conf.frag);
+            if(run_play(image, &conf, &refill, &errors, &load))
+            {
+                printf("playback error\n");
+                err = 1;
+            }
+            else
+            {
+                printf("%10.1f %7.1f %6lu\n", refill, load, (unsigned long)errors);
+            }
+        }
+    }
+    conf.meta = 0;
+
+    printf("\ntrack open, last of %u files\n", OPEN_FILES);
+    printf("FAT clust | path+header(us) index(us) errors | walk by path(ms) by entry(ms)\n");
+    conf.nfiles = OPEN_FILES;
+    conf.nsamples = OPEN_SAMPLES;
+    conf.index = 1;
+    conf.frag = 0;
+    conf.freq = SAMPLE_FREQ_MAX;
+    conf.bits = 8;
+    conf.channels = 1;
+    conf.g711 = 0;
+    for(i = 0; i < sizeof(sweep); i++)
+    {
+        conf.fat_type = configs[sweep[i]].fat_type;
+        conf.csize = configs[sweep[i]].csize;
+        printf(" %2u %5u | ", conf.fat_type, conf.csize);
+
+        tolerance = 0;
+        host_reset();
+        if(fatimg_create(image, &conf) || host_disk_open(image) || pf_mount(&fs) != FR_OK
+            || bench_open(&conf, &by_path, &by_index, &errors)
+            || bench_walk(0, &walk_path) || bench_walk(1, &walk_entry))
+        {
+            printf("open error\n");
+            err = 1;
+        }
+        else
+        {
+            printf("%15.1f %9.1f %6lu | %16.1f %12.1f\n", by_path, by_index, (unsigned long)errors,
+                walk_path, walk_entry);
+        }
+        host_disk_close();
+        unlink(image);
+    }
+
+    printf("\ntrack open, contiguous file\n");
+    printf("FAT clust    size(kB) | path+header(us) contig at open/end errors\n");
+    conf.nfiles = 1;
+    conf.index = 0;
+    for(i = 0; i < sizeof(opencost) / sizeof(opencost[0]); i++)
+    {
+        uint8_t contig[2];
+
+        conf.fat_type = opencost[i].fat_type;
+        conf.csize = opencost[i].csize;
+        conf.nsamples = opencost[i].kbytes * 1024;
+        printf(" %2u %5u %11lu | ", conf.fat_type, conf.csize, (unsigned long)opencost[i].kbytes);
+        fflush(stdout);
+
+        host_reset();
+        if(fatimg_create(image, &conf) || host_disk_open(image) || pf_mount(&fs) != FR_OK
+            || bench_opencost(&conf, &by_path, contig, &errors))
+        {
+            printf("open error\n");
+            err = 1;
+        }
+        else
+        {
+            printf("%15.1f %11u/%u %6lu\n", by_path, contig[0], contig[1], (unsigned long)errors);
+        }
+        host_disk_close();
+        unlink(image);
+    }
+
+    free(played);
+    free(expected);
+    return err;
+}
@@ -0,0 +1,551 @@
+/*---------------------------------------------------------------------------/
+/ fatimg - FAT16/FAT32 test image generator
+/----------------------------------------------------------------------------*/
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "fatimg.h"
+
+#define SECTOR          512
+#define NFATS           2
+#define ROOT_ENTRIES    512     /* FAT16 static root directory */
+
+/* file system layout */
+typedef struct {
+    FILE*       f;
+    uint8_t     fat32;
+    uint8_t     csize;
+    uint32_t    nclust;     /* number of data clusters */
+    uint32_t    fatsz;      /* sectors per FAT */
+    uint32_t    rsvd;       /* reserved sectors */
+    uint32_t    fatbase;
+    uint32_t    rootbase;   /* FAT16 root directory sector */
+    uint32_t    database;
+    uint32_t*   fat;        /* FAT in memory, written at the end */
+} LAYOUT;
+
+static void st_word(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void st_dword(uint8_t* p, uint32_t v)
+{
+    st_word(p, (uint16_t)v);
+    st_word(p + 2, (uint16_t)(v >> 16));
+}
+
+uint8_t fatimg_sample(uint8_t file, uint32_t n)
+{
+    uint32_t x = n * 2654435761UL + (uint32_t)file * 40503UL;
+
+    return (uint8_t)((x >> 24) ^ (n >> 8));
+}
+
+static int write_at(LAYOUT* l, uint32_t sect, uint32_t ofs, const void* buf, size_t len)
+{
+    return pwrite(fileno(l->f), buf, len, (off_t)sect * SECTOR + ofs) != (ssize_t)len;
+}
+
+static uint32_t clust2sect(const LAYOUT* l, uint32_t clst)
+{
+    return l->database + (clst - 2) * l->csize;
+}
+
+/* write the content of a cluster chain */
+static int write_chain(LAYOUT* l, uint32_t clst, const uint8_t* data, uint32_t len)
+{
+    uint32_t bcs = (uint32_t)l->csize * SECTOR, n;
+
+    while(len)
+    {
+        n = len < bcs ? len : bcs;
+        if(write_at(l, clust2sect(l, clst), 0, data, n)) return 1;
+        data += n;
+        len -= n;
+        clst = l->fat[clst];
+    }
+    return 0;
+}
+
+static void dir_entry(uint8_t* e, const char* name, uint8_t attr, uint32_t clst, uint32_t size)
+{
+    memset(e, 0, 32);
+    memcpy(e, name, 11);
+    e[11] = attr;
+    st_word(e + 20, (uint16_t)(clst >> 16));
+    st_word(e + 26, (uint16_t)clst);
+    st_dword(e + 28, size);
+}
+
+/* fmt chunk content : 16 bytes, 18 with an empty extension before metadata,
+ * 20 for ADPCM (samples per block extension) */
+static uint32_t fmt_size(const FATIMG* conf)
+{
+    if(conf->bits == 4) return 20;
+    return conf->meta || conf->g711 ? 18 : 16;     /* G.711 : non-PCM, extension size field */
+}
+
+uint32_t fatimg_header(const FATIMG* conf)
+{
+    uint32_t sz = 12 + 8 + fmt_size(conf) + 8;
+
+    if(conf->meta) sz += 8 + conf->meta + (conf->meta & 1U);    /* LIST chunk padded to an even size */
+    return sz;
+}
+
+uint32_t fatimg_data_size(const FATIMG* conf)
+{
+    uint32_t full, rem;
+
+    if(conf->bits != 4) return conf->nsamples * FATIMG_FRAME_SIZE(conf);
+    full = conf->nsamples / FATIMG_ADPCM_SAMPLES;
+    rem = conf->nsamples % FATIMG_ADPCM_SAMPLES;
+    /* the last block is shortened, its header holds the first sample */
+    return full * FATIMG_ADPCM_BLOCK + (rem ? 4 + rem / 2 : 0);
+}
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * G.711 encoder, the nearest code to a 16-bit value
+ */
+static int32_t g711_linear(uint8_t code, uint8_t g711)
+{
+    uint8_t c, e, m;
+    int32_t mag;
+
+    if(g711 == 7)   /* mu-law, stored inverted */
+    {
+        c = (uint8_t)~code;
+        e = (c >> 4) & 7;
+        m = c & 0x0F;
+        mag = ((((int32_t)m << 3) + 0x84) << e) - 0x84;
+        return (c & 0x80) ? -mag : mag;
+    }
+    c = code ^ 0x55;    /* A-law, even bits inverted, sign bit set for positive values */
+    e = (c >> 4) & 7;
+    m = c & 0x0F;
+    mag = e ? (((int32_t)m << 4) + 0x108) << (e - 1) : ((int32_t)m << 4) + 8;
+    return (c & 0x80) ? mag : -mag;
+}
+
+static uint8_t g711_pwm(int32_t v)
+{
+    int32_t u = (v + 32768 + 128) >> 8;
+
+    return (uint8_t)(u > 255 ? 255 : u);
+}
+
+static uint8_t g711_code(uint8_t s, uint8_t g711)
+{
+    static uint8_t codes[2][256], done[2];
+    uint8_t* t = codes[g711 == 7];
+    int32_t v, d, best;
+    unsigned i, c;
+
+    if(!done[g711 == 7])
+    {
+        for(i = 0; i < 256; i++)
+        {
+            v = (int32_t)(int16_t)((i ^ 0x80U) << 8);
+            for(best = -1, c = 0; c < 256; c++)
+            {
+                d = labs((long)(g711_linear((uint8_t)c, g711) - v));
+                if(best < 0 || d < best) { best = d; t[i] = (uint8_t)c; }
+            }
+        }
+        done[g711 == 7] = 1;
+    }
+    return t[s];
+}
+
+uint8_t fatimg_g711_sample(uint8_t file, uint32_t n, uint8_t g711)
+{
+    return g711_pwm(g711_linear(g711_code(fatimg_sample(file, n), g711), g711));
+}
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * IMA ADPCM encoder, the decoder is run along
+ */
+static const uint16_t adpcm_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+static const int adpcm_index_step[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+typedef struct {
+    int32_t pred;
+    int index;
+} ADPCM;
+
+static int32_t adpcm_input(uint8_t file, uint32_t n)
+{
+    return (int32_t)(int16_t)((fatimg_sample(file, n) ^ 0x80U) << 8);
+}
+
+/* encode a sample to a nibble and update the state as the decoder does */
+static uint8_t adpcm_encode(ADPCM* a, int32_t v)
+{
+    int32_t step = adpcm_steps[a->index], diff = v - a->pred, dq;
+    uint8_t nib = 0;
+
+    if(diff < 0) { nib = 8; diff = -diff; }
+    if(diff >= step) { nib |= 4; diff -= step; }
+    if(diff >= step / 2) { nib |= 2; diff -= step / 2; }
+    if(diff >= step / 4) nib |= 1;
+
+    dq = step / 8;
+    if(nib & 4) dq += step;
+    if(nib & 2) dq += step / 2;
+    if(nib & 1) dq += step / 4;
+    a->pred += (nib & 8) ? -dq : dq;
+    if(a->pred > 32767) a->pred = 32767;
+    if(a->pred < -32768) a->pred = -32768;
+    a->index += adpcm_index_step[nib & 7];
+    if(a->index < 0) a->index = 0;
+    if(a->index > 88) a->index = 88;
+    return nib;
+}
+
+/* encode the data chunk content to p (may be NULL), the decoded samples to out */
+static uint32_t adpcm_file(uint8_t* p, uint8_t file, const FATIMG* conf, uint8_t* out, uint32_t max)
+{
+    ADPCM a = {0, 0};
+    uint32_t n = 0, played = 0, i;
+    uint8_t nib[2];
+    unsigned k;
+
+#define ADPCM_OUT(v) do { if(played < max) out[played] = (uint8_t)(((uint16_t)(v) >> 8) ^ 0x80U); played++; } while(0)
+    while(n < conf->nsamples)
+    {
+        /* block header, its sample is played as is */
+        a.pred = adpcm_input(file, n++);
+        if(p)
+        {
+            st_word(p, (uint16_t)a.pred);
+            p[2] = (uint8_t)a.index;
+            p[3] = 0;
+            p += 4;
+        }
+        ADPCM_OUT(a.pred);
+        for(i = 1; i < FATIMG_ADPCM_SAMPLES && n < conf->nsamples; i += 2)
+        {
+            for(k = 0; k < 2; k++)  /* a padding sample repeats the last one */
+            {
+                nib[k] = adpcm_encode(&a, adpcm_input(file, n < conf->nsamples ? n : n - 1));
+                n++;
+                ADPCM_OUT(a.pred);
+            }
+            if(p) *p++ = (uint8_t)(nib[0] | (nib[1] << 4));
+        }
+    }
+#undef ADPCM_OUT
+    return played;
+}
+
+uint32_t fatimg_adpcm_ref(uint8_t file, const FATIMG* conf, uint8_t* out, uint32_t max)
+{
+    return adpcm_file(NULL, file, conf, out, max);
+}
+
+/* store a frame of the generated file */
+static void wav_frame(uint8_t* p, uint8_t file, uint32_t n, const FATIMG* conf)
+{
+    uint8_t s = fatimg_sample(file, n);
+    int32_t v = (int32_t)(int16_t)(((s ^ 0x80U) << 8) | ((n * 37U) & 0xFFU));   /* low byte filled with a pattern */
+    int32_t d16 = (v > -0x7000 && v < 0x7000) ? 0x400 : 0;
+    uint8_t d8 = (s >= 16 && s < 240) ? 16 : 0;
+
+    if(conf->channels == 2)
+    {
+        if(conf->bits == 16)
+        {
+            st_word(p, (uint16_t)(v + d16));
+            st_word(p + 2, (uint16_t)(v - d16));
+        }
+        else
+        {
+            p[0] = (uint8_t)(s + d8);
+            p[1] = (uint8_t)(s - d8);
+        }
+    }
+    else if(conf->bits == 16) st_word(p, (uint16_t)v);
+    else p[0] = s;
+}
+
+static void wav_file(uint8_t* buf, uint8_t file, const FATIMG* conf)
+{
+    uint32_t hsz = fatimg_header(conf), i;
+    uint32_t fsz = FATIMG_FRAME_SIZE(conf), dsz = fatimg_data_size(conf);
+    uint16_t nch = conf->channels == 2 && conf->bits != 4 ? 2 : 1;
+    uint8_t* p = buf + 12;
+
+    memcpy(buf, "RIFF", 4);
+    st_dword(buf + 4, hsz - 8 + dsz);
+    memcpy(buf + 8, "WAVE", 4);
+
+    memcpy(p, "fmt ", 4);
+    st_dword(p + 4, fmt_size(conf));
+    st_word(p + 10, nch);
+    st_dword(p + 12, conf->freq);
+    if(conf->bits == 4)
+    {
+        st_word(p + 8, 0x11);           /* IMA ADPCM */
+        st_dword(p + 16, (uint32_t)((uint64_t)conf->freq * FATIMG_ADPCM_BLOCK / FATIMG_ADPCM_SAMPLES));
+        st_word(p + 20, FATIMG_ADPCM_BLOCK);
+        st_word(p + 22, 4);
+        st_word(p + 24, 2);             /* extension : samples per block */
+        st_word(p + 26, FATIMG_ADPCM_SAMPLES);
+        p += 28;
+    }
+    else
+    {
+        st_word(p + 8, conf->g711 ? conf->g711 : 1);   /* G.711 or LPCM */
+        st_dword(p + 16, conf->freq * fsz); /* bytes per second */
+        st_word(p + 20, (uint16_t)fsz); /* block align */
+        st_word(p + 22, (uint16_t)(FATIMG_SAMPLE_SIZE(conf) * 8)); /* bits per sample */
+        p += 24;
+        if(conf->meta || conf->g711)
+        {
+            st_word(p, 0);              /* empty fmt extension */
+            p += 2;
+        }
+    }
+    if(conf->meta)
+    {
+        memcpy(p, "LIST", 4);           /* metadata, as written by audio editors */
+        st_dword(p + 4, conf->meta);
+        memset(p + 8, 'm', conf->meta + (conf->meta & 1U));
+        p += 8 + conf->meta + (conf->meta & 1U);
+    }
+
+    memcpy(p, "data", 4);
+    st_dword(p + 4, dsz);
+    if(conf->bits == 4) adpcm_file(buf + hsz, file, conf, NULL, 0);
+    else if(conf->g711) for(i = 0; i < conf->nsamples; i++)
+        buf[hsz + i] = g711_code(fatimg_sample(file, i), conf->g711);
+    else for(i = 0; i < conf->nsamples; i++)
+        wav_frame(buf + hsz + i * fsz, file, i, conf);
+}
+
+/* playlist index of the files, as written by mkplaylist */
+static uint32_t index_file(uint8_t* buf, const uint32_t* first, const FATIMG* conf)
+{
+    uint8_t* t;
+    uint32_t i;
+
+    memcpy(buf, "WIDX", 4);
+    st_word(buf + 4, 1);                /* version */
+    st_word(buf + 6, conf->nfiles);
+    for(i = 0; i < conf->nfiles; i++)
+    {
+        t = buf + 8 + i * 32;
+        memset(t, 0, 32);
+        snprintf((char*)t, 13, "TRACK%02u.WAV", (unsigned)(i % 100));
+        st_dword(t + 12, first[i]);
+        st_dword(t + 16, fatimg_header(conf));
+        st_dword(t + 20, fatimg_data_size(conf));
+        st_word(t + 24, (uint16_t)conf->freq);
+        if(conf->bits == 4)
+        {
+            st_word(t + 26, 0x11);
+            t[28] = 1;
+            t[29] = 4;
+            st_word(t + 30, FATIMG_ADPCM_BLOCK);
+        }
+        else
+        {
+            st_word(t + 26, conf->g711 ? conf->g711 : 1);
+            t[28] = conf->channels == 2 ? 2 : 1;
+            t[29] = (uint8_t)(FATIMG_SAMPLE_SIZE(conf) * 8);
+            st_word(t + 30, (uint16_t)FATIMG_FRAME_SIZE(conf));
+        }
+    }
+    return 8 + i * 32;
+}
+
+/* allocate the files chains, interleaving their fragments */
+static uint32_t allocate(LAYOUT* l, uint32_t next, uint32_t* first, uint32_t nclst, uint8_t nfiles, uint16_t frag)
+{
+    uint32_t last[100] = {0}, left[100];
+    uint8_t f, busy;
+    uint16_t k;
+
+    for(f = 0; f < nfiles; f++) left[f] = nclst;
+    if(!frag) frag = 0xFFFF;
+
+    do
+    {
+        busy = 0;
+        for(f = 0; f < nfiles; f++)
+        {
+            for(k = 0; k < frag && left[f]; k++, left[f]--)
+            {
+                if(last[f]) l->fat[last[f]] = next;
+                else first[f] = next;
+                last[f] = next++;
+            }
+            if(left[f]) busy = 1;
+        }
+    }while(busy);
+
+    for(f = 0; f < nfiles; f++)
+        l->fat[last[f]] = 0x0FFFFFFF;
+
+    return next;
+}
+
+int fatimg_create(const char* path, const FATIMG* conf)
+{
+    LAYOUT l;
+    uint8_t bs[SECTOR], *dir = NULL, *wav = NULL, *fatsec = NULL, idx[8 + 99 * 32];
+    uint32_t bcs, fsize, nclst, tsect, first[100], i, k, v, x, isz;
+    uint32_t dirsz, dclst;
+    char name[12];
+    int err = 1;
+
+    if(conf->nfiles < 1 || conf->nfiles > 99) return 1;
+    if(conf->fat_type != 16 && conf->fat_type != 32) return 1;
+    if(conf->bits && conf->bits != 4 && conf->bits != 8 && conf->bits != 16) return 1;
+    if(conf->channels > 2) return 1;
+    if(conf->g711 && (conf->g711 < 6 || conf->g711 > 7 || conf->bits == 4 || FATIMG_FRAME_SIZE(conf) != 1)) return 1;
+
+    memset(&l, 0, sizeof(l));
+    l.fat32 = conf->fat_type == 32;
+    l.csize = conf->csize;
+    bcs = (uint32_t)conf->csize * SECTOR;
+    fsize = fatimg_header(conf) + fatimg_data_size(conf);
+    nclst = (fsize + bcs - 1) / bcs;
+    dirsz = (uint32_t)(conf->nfiles + 2) * 32;
+    dclst = (dirsz + bcs - 1) / bcs;
+
+    /* the cluster count decides of the FAT sub type, see pf_mount() */
+    l.nclust = dclst + nclst * conf->nfiles + 16;
+    if(l.fat32 && l.nclust < 0xFFF5 + 16) l.nclust = 0xFFF5 + 16;
+    if(!l.fat32 && l.nclust < 0xFF6 + 16) l.nclust = 0xFF6 + 16;
+    if(!l.fat32 && l.nclust > 0xFFF4) return 1;
+
+    l.rsvd = l.fat32 ? 32 : 1;
+    l.fatsz = ((l.nclust + 2) * (l.fat32 ? 4 : 2) + SECTOR - 1) / SECTOR;
+    l.fatbase = l.rsvd;
+    l.rootbase = l.fatbase + NFATS * l.fatsz;
+    l.database = l.rootbase + (l.fat32 ? 0 : ROOT_ENTRIES * 32 / SECTOR);
+    tsect = l.database + l.nclust * l.csize;
+
+    l.fat = calloc(l.nclust + 2, sizeof(uint32_t));
+    dir = calloc(dclst, bcs);
+    wav = malloc(fsize);
+    fatsec = malloc(SECTOR);
+    l.f = fopen(path, "w+b");
+    if(!l.fat || !dir || !wav || !fatsec || !l.f) goto end;
+    if(ftruncate(fileno(l.f), (off_t)tsect * SECTOR)) goto end;
+
+    /* boot sector */
+    memset(bs, 0, sizeof(bs));
+    memcpy(bs, "\xEB\x58\x90" "MSWIN4.1", 11);
+    st_word(bs + 11, SECTOR);
+    bs[13] = l.csize;
+    st_word(bs + 14, (uint16_t)l.rsvd);
+    bs[16] = NFATS;
+    st_word(bs + 17, l.fat32 ? 0 : ROOT_ENTRIES);
+    bs[21] = 0xF8;
+    st_dword(bs + 32, tsect);
+    if(l.fat32)
+    {
+        st_dword(bs + 36, l.fatsz);
+        st_dword(bs + 44, 2);           /* root directory cluster */
+        st_word(bs + 48, 1);            /* FSInfo sector */
+        bs[66] = 0x29;
+        memcpy(bs + 71, "NO NAME    FAT32   ", 19);
+    }
+    else
+    {
+        st_word(bs + 22, (uint16_t)l.fatsz);
+        bs[38] = 0x29;
+        memcpy(bs + 43, "NO NAME    FAT16   ", 19);
+    }
+    bs[510] = 0x55;
+    bs[511] = 0xAA;
+    if(write_at(&l, 0, 0, bs, SECTOR)) goto end;
+
+    /* clusters : 2 WAV directory (root on FAT32, the WAV directory follows the files),
+     * files after */
+    l.fat[0] = 0x0FFFFFF8;
+    l.fat[1] = 0x0FFFFFFF;
+    memset(dir, 0, bcs);
+    if(l.fat32)
+    {
+        l.fat[2] = 0x0FFFFFFF;
+        k = allocate(&l, 3, first, nclst, conf->nfiles, conf->frag);
+        x = k + dclst;
+    }
+    else
+    {
+        k = 2;
+        x = allocate(&l, 2 + dclst, first, nclst, conf->nfiles, conf->frag);
+    }
+    for(i = 0; i < dclst; i++)          /* WAV directory, contiguous */
+        l.fat[k + i] = k + i + 1;
+    l.fat[k + i - 1] = 0x0FFFFFFF;
+    dir_entry(dir, "WAV        ", 0x10, k, 0);
+    if(conf->index)                     /* the index follows, contiguous */
+    {
+        isz = index_file(idx, first, conf);
+        for(i = 0; i < (isz + bcs - 1) / bcs; i++)
+            l.fat[x + i] = x + i + 1;
+        l.fat[x + i - 1] = 0x0FFFFFFF;
+        dir_entry(dir + 32, "PLAYLISTIDX", 0x20, x, isz);
+        if(write_chain(&l, x, idx, isz)) goto end;
+    }
+    if(l.fat32)
+    {
+        if(write_at(&l, clust2sect(&l, 2), 0, dir, bcs)) goto end;
+    }
+    else
+    {
+        if(write_at(&l, l.rootbase, 0, dir, 64)) goto end;
+    }
+
+    /* WAV directory and files */
+    memset(dir, 0, dclst * bcs);
+    dir_entry(dir, ".          ", 0x10, k, 0);
+    dir_entry(dir + 32, "..         ", 0x10, 0, 0);
+    for(i = 0; i < conf->nfiles; i++)
+    {
+        snprintf(name, sizeof(name), "TRACK%02u WAV", (unsigned)(i % 100));
+        dir_entry(dir + 64 + i * 32, name, 0x20, first[i], fsize);
+        wav_file(wav, (uint8_t)i, conf);
+        if(write_chain(&l, first[i], wav, fsize)) goto end;
+    }
+    if(write_chain(&l, k, dir, dclst * bcs)) goto end;
+
+    /* FATs */
+    for(i = 0; i < l.fatsz; i++)
+    {
+        memset(fatsec, 0, SECTOR);
+        for(k = 0; k < SECTOR / (l.fat32 ? 4 : 2); k++)
+        {
+            v = i * (SECTOR / (l.fat32 ? 4 : 2)) + k;
+            if(v >= l.nclust + 2) break;
+            if(l.fat32) st_dword(fatsec + k * 4, l.fat[v]);
+            else st_word(fatsec + k * 2, (uint16_t)l.fat[v]);
+        }
+        for(k = 0; k < NFATS; k++)
+            if(write_at(&l, l.fatbase + k * l.fatsz + i, 0, fatsec, SECTOR)) goto end;
+    }
+    err = 0;
+
+end:
+    if(l.f && fclose(l.f)) err = 1;
+    free(l.fat);
+    free(dir);
+    free(wav);
+    free(fatsec);
+    return err;
+}
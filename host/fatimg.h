@@ -0,0 +1,61 @@
+/*---------------------------------------------------------------------------/
+/ fatimg - FAT16/FAT32 test image generator
+/
+/ Builds a superfloppy disk image holding a WAV directory of 8 or 16-bit,
+/ mono or stereo LPCM files, or of IMA ADPCM or G.711 mono files. The cluster size and the fragmentation of the files are
+/ configurable, the file contents are known so that played samples can be
+/ checked against fatimg_sample().
+/----------------------------------------------------------------------------*/
+#ifndef FATIMG_H
+#define FATIMG_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint8_t     fat_type;   /* 16 or 32 */
+    uint8_t     csize;      /* sectors per cluster, power of 2 up to 128 */
+    uint16_t    frag;       /* clusters per fragment, files are interleaved fragment by fragment (0:contiguous) */
+    uint8_t     nfiles;     /* number of files in the WAV directory, up to 99 */
+    uint32_t    nsamples;   /* samples per file */
+    uint32_t    freq;       /* sample frequency */
+    uint16_t    meta;       /* size of a LIST chunk and of a fmt extension before the data (0:44-byte header) */
+    uint8_t     bits;       /* bits per sample, 8 or 16 (0:8), 4 : IMA ADPCM mono */
+    uint8_t     channels;   /* 1 or 2 (0:1) */
+    uint8_t     g711;       /* 8-bit mono G.711 files, format tag : 7 mu-law, 6 A-law (0:LPCM) */
+    uint8_t     index;      /* 1 : PLAYLIST.IDX of the files in the root directory, see playwaveutils.h */
+} FATIMG;
+
+/* create the disk image, 0 : success */
+int fatimg_create(const char* path, const FATIMG* conf);
+
+/* expected value of a sample of a generated file, as played (8-bit unsigned).
+ * 16-bit files hold it in the high byte of their samples, an 8-bit
+ * conversion may differ by 1. The channels of stereo files are spread
+ * around it, their mean is the expected value */
+uint8_t fatimg_sample(uint8_t file, uint32_t n);
+
+/* played value of a sample of a G.711 file : the expansion of the code
+ * nearest to fatimg_sample(), rounded to 8-bit unsigned */
+uint8_t fatimg_g711_sample(uint8_t file, uint32_t n, uint8_t g711);
+
+/* IMA ADPCM files : bytes per block and samples per block */
+#define FATIMG_ADPCM_BLOCK          256U
+#define FATIMG_ADPCM_SAMPLES        ((FATIMG_ADPCM_BLOCK - 4U) * 2U + 1U)
+
+/* samples played from an IMA ADPCM file, the decoder output of its
+ * content, which is the encoded fatimg_sample() sequence. Up to max
+ * samples are stored to out, the number of samples is returned, the
+ * last block may hold a padding sample */
+uint32_t fatimg_adpcm_ref(uint8_t file, const FATIMG* conf, uint8_t* out, uint32_t max);
+
+/* bytes per sample and per frame of the LPCM generated files */
+#define FATIMG_SAMPLE_SIZE(conf)    ((conf)->bits == 16 ? 2U : 1U)
+#define FATIMG_FRAME_SIZE(conf)     (FATIMG_SAMPLE_SIZE(conf) * ((conf)->channels == 2 ? 2U : 1U))
+
+/* size of the generated WAV header, the data chunk content follows */
+uint32_t fatimg_header(const FATIMG* conf);
+
+/* size of the data chunk content */
+uint32_t fatimg_data_size(const FATIMG* conf);
+
+#endif
@@ -0,0 +1,193 @@
+/*---------------------------------------------------------------------------/
+/ hostdisk - file backed disk for the host build
+/----------------------------------------------------------------------------*/
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "diskio.h"
+#include "hostio.h"
+#include "hostdisk.h"
+#include "playwaveutils.h"
+
+SPI_MODEL host_spi = {
+    24,     /* 16 cycles per byte at SCK = F_CPU/2, plus the spi() polling and store loop */
+    2,
+    100,
+    8,
+    24      /* the pipelined loops, see make spicycles : 20 to 24 cycles depending on when SPIF is seen */
+};
+DISK_STATS host_disk;
+
+static FILE* image;
+static uint8_t ready;
+
+#if USE_MULTI_BLOCK_READ
+/* state of the pending READ_MULTI_BLOCK transaction, as in avr_mmcp.c */
+static uint8_t rdOpen;
+static DWORD rdSector;
+static UINT rdOffset;
+#endif
+
+/* clock bytes on the bus, at a cost per byte */
+static void bus_bytes(uint32_t n, uint16_t byte_cycles)
+{
+    uint32_t cycles = n * byte_cycles;
+
+    host_disk.bytes += n;
+    host_disk.cycles += cycles;
+    host_advance(cycles);
+}
+
+/* bytes exchanged one at a time by spi() */
+static void clock_bytes(uint32_t n)
+{
+    bus_bytes(n, host_spi.byte_cycles);
+}
+
+/* bytes received by the pipelined loops, skip_data(), rx_block() and rx_forward() */
+static void stream_bytes(uint32_t n)
+{
+    bus_bytes(n, host_spi.stream_cycles);
+}
+
+/* send_cmd() : extra clocks (none for STOP_READ, sent within the
+ * data stream), command frame and response */
+static void command(uint8_t stop)
+{
+    host_disk.commands++;
+    clock_bytes((stop ? 0U : 2U) + 6 + stop + host_spi.ncr);
+}
+
+/* data token wait */
+static void token(void)
+{
+    host_disk.tokens++;
+    clock_bytes(host_spi.nac + 1U);
+}
+
+static DRESULT read_sector(BYTE* buff, DWORD sector, UINT offset, UINT count)
+{
+    BYTE sect[512];
+
+    if(pread(fileno(image), sect, sizeof(sect), (off_t)sector * 512) != (ssize_t)sizeof(sect))
+        return RES_ERROR;
+    if(buff) memcpy(buff, sect + offset, count);
+    else
+    {
+        uint8_t fwd = ring_fwd;     /* forwarded around the sample ring, as avr_mmcp.c does */
+        UINT i;
+
+        for(i = 0; i < count; i++)
+            RING_FORWARD(fwd, sect[offset + i]);
+        ring_fwd = fwd;
+    }
+    return RES_OK;
+}
+
+int host_disk_open(const char* path)
+{
+    host_disk_close();
+    image = fopen(path, "rb");
+    return image == NULL;
+}
+
+void host_disk_close(void)
+{
+    if(image) fclose(image);
+    image = NULL;
+    ready = 0;
+}
+
+DSTATUS disk_initialize(void)
+{
+#if USE_MULTI_BLOCK_READ
+    rdOpen = 0;
+#endif
+    memset(&host_disk, 0, sizeof(host_disk));
+    ready = image != NULL;
+    return ready ? 0 : STA_NOINIT;
+}
+
+#if USE_MULTI_BLOCK_READ
+
+DRESULT disk_stop_read(void)
+{
+    if(rdOpen)
+    {
+        rdOpen = 0;
+        command(1);
+        clock_bytes(host_spi.busy + 1U + 1U);   /* busy, ready and deselection bytes */
+    }
+    return RES_OK;
+}
+
+DRESULT disk_readp(BYTE* buff, DWORD sector, UINT offset, UINT count)
+{
+    if(!ready) return RES_NOTRDY;
+    if(offset + count > 512) return RES_PARERR;
+
+    host_disk.reads++;
+    if(rdOpen)
+    {
+        if(sector == rdSector + 1 && rdOffset == 512)
+        {
+            stream_bytes(2);
+            token();
+            rdSector = sector;
+            rdOffset = 0;
+        }
+        else if(sector != rdSector || offset < rdOffset)
+        {
+            disk_stop_read();
+        }
+    }
+
+    if(!rdOpen)
+    {
+        command(0);
+        token();
+        rdOpen = 1;
+        rdSector = sector;
+        rdOffset = 0;
+    }
+
+    stream_bytes(offset - rdOffset + count);
+    rdOffset = offset + count;
+
+    return read_sector(buff, sector, offset, count);
+}
+
+#if PF_USE_ASYNC
+/* the background read is completed at once, its bus time
+ * is stolen from the main loop as the SPI interrupts would do
+ */
+DRESULT disk_readp_start(BYTE* buff, DWORD sector, UINT offset, UINT count)
+{
+    if(!buff || !count) return RES_PARERR;
+    return disk_readp(buff, sector, offset, count);
+}
+
+BYTE disk_readp_busy(void)
+{
+    return 0;
+}
+#endif
+
+#else
+
+DRESULT disk_readp(BYTE* buff, DWORD sector, UINT offset, UINT count)
+{
+    if(!ready) return RES_NOTRDY;
+    if(offset + count > 512) return RES_PARERR;
+
+    host_disk.reads++;
+    command(0);
+    token();
+    stream_bytes(512 + 2);      /* whole block and CRC */
+    clock_bytes(1);             /* deselection */
+
+    return read_sector(buff, sector, offset, count);
+}
+
+#endif
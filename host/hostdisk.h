@@ -0,0 +1,39 @@
+/*---------------------------------------------------------------------------/
+/ hostdisk - file backed disk for the host build
+/
+/ Implements the diskio.h interface on top of a FAT16/FAT32 disk image
+/ (or a raw card device) so that pff can be run on the build machine.
+/ The SPI protocol of avr_mmcp.c is replayed on a cost model : every byte
+/ the target would clock on the bus advances the simulated clock.
+/----------------------------------------------------------------------------*/
+#ifndef HOSTDISK_H
+#define HOSTDISK_H
+
+#include <stdint.h>
+
+/* SPI cost model */
+typedef struct {
+    uint16_t    byte_cycles;    /* CPU cycles per byte exchanged by spi() (SCK = F_CPU/2 + loop) : commands, waits */
+    uint8_t     ncr;            /* bytes clocked before a command response */
+    uint16_t    nac;            /* bytes clocked before a data token, card access time */
+    uint16_t    busy;           /* busy bytes after STOP_READ */
+    uint16_t    stream_cycles;  /* CPU cycles per byte of the pipelined receive loops : data, skips, CRC */
+} SPI_MODEL;
+
+/* transfer counters */
+typedef struct {
+    uint32_t    reads;          /* disk_readp() calls */
+    uint32_t    commands;       /* commands issued */
+    uint32_t    tokens;         /* data token waits */
+    uint32_t    bytes;          /* bytes clocked on the bus */
+    uint64_t    cycles;         /* CPU cycles spent on the bus */
+} DISK_STATS;
+
+extern SPI_MODEL host_spi;
+extern DISK_STATS host_disk;
+
+/* open the disk image, to be called before pf_mount(). 0 : success */
+int host_disk_open(const char* path);
+void host_disk_close(void);
+
+#endif
@@ -0,0 +1,116 @@
+/*---------------------------------------------------------------------------/
+/ hostio - AVR peripherals simulation for the host build
+/----------------------------------------------------------------------------*/
+#include <stddef.h>
+#include "hostio.h"
+
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+volatile uint16_t TCNT1, OCR1A;
+volatile uint8_t TCCR2A, TCCR2B, TIMSK2, TCNT2, OCR2B;
+volatile uint8_t DDRD;
+volatile uint8_t SREG;
+
+uint64_t host_cycles;
+uint16_t host_isr_cycles = 60;      /* C ring buffer interrupt, 34 for the ASM_ISR version (make isrcycles) */
+uint32_t host_busy_max;
+uint64_t host_work_cycles;
+void (*host_sink)(uint8_t sample);
+
+static uint64_t next_tick;  /* cycle of the next sample timer compare match, 0 : not scheduled */
+static uint8_t pending;     /* compare match raised while interrupts were disabled */
+static uint32_t starts;     /* number of sample timer starts */
+static uint64_t busy_start; /* end of the last busy loop iteration */
+static uint32_t busy_start_id;  /* timer start during which busy_start was taken, 0 : timer stopped */
+
+/* sample timer period in CPU cycles, 0 when the timer is stopped */
+static uint32_t timer1_period(void)
+{
+    static const uint16_t prescaler[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+    uint32_t top = (TCCR1B & _BV(WGM12)) ? (uint32_t)OCR1A + 1UL : 0x10000UL;   /* CTC or normal mode */
+
+    if(!(TIMSK1 & _BV(OCIE1A))) return 0;
+    return (uint32_t)prescaler[TCCR1B & 0x07] * top;
+}
+
+/* run the sample timer interrupt as the hardware would */
+static void sample_tick(void)
+{
+    cli();
+    TIMER1_COMPA_vect();
+    sei();
+
+    if(host_sink && (TCCR2B & _BV(CS20))) host_sink(OCR2B);
+}
+
+void host_advance(uint32_t cycles)
+{
+    uint64_t end = host_cycles + cycles;
+    uint32_t period;
+
+    if(pending && (SREG & _BV(SREG_I)))
+    {
+        pending = 0;
+        sample_tick();
+        end += host_isr_cycles;
+    }
+
+    for(;;)
+    {
+        period = timer1_period();
+        if(!period)
+        {
+            next_tick = 0;
+            break;
+        }
+        if(!next_tick)
+        {
+            next_tick = host_cycles + period;
+            starts++;
+        }
+        if(next_tick > end) break;
+
+        host_cycles = next_tick;
+        next_tick += period;
+        if(SREG & _BV(SREG_I))
+        {
+            sample_tick();
+            end += host_isr_cycles;
+        }
+        else pending = 1;
+    }
+
+    host_cycles = end;
+}
+
+void host_idle(void)
+{
+    if(busy_start_id == starts && next_tick && host_cycles - busy_start > host_busy_max)
+        host_busy_max = (uint32_t)(host_cycles - busy_start);
+
+    if(next_tick > host_cycles) host_advance((uint32_t)(next_tick - host_cycles));
+    else host_advance(1);
+
+    busy_start = host_cycles;
+    busy_start_id = next_tick ? starts : 0;
+}
+
+void host_work(uint32_t cycles)
+{
+    host_work_cycles += cycles;
+    host_advance(cycles);
+}
+
+void host_reset(void)
+{
+    TCCR1A = TCCR1B = TIMSK1 = 0;
+    TCNT1 = OCR1A = 0;
+    TCCR2A = TCCR2B = TIMSK2 = TCNT2 = OCR2B = 0;
+    DDRD = SREG = 0;
+    host_cycles = 0;
+    host_busy_max = 0;
+    host_work_cycles = 0;
+    next_tick = 0;
+    pending = 0;
+    busy_start = 0;
+    busy_start_id = 0;
+}
@@ -0,0 +1,88 @@
+/*---------------------------------------------------------------------------/
+/ hostio - AVR peripherals simulation for the host build
+/
+/ Replaces <avr/io.h>, <avr/interrupt.h> and <avr/pgmspace.h> when the player stack is built
+/ for the build machine. The timer and PWM registers used by playwaveutils
+/ are plain variables, the sample timer interrupt is raised by the
+/ simulated clock and every sample written to the PWM is sent to a sink.
+/----------------------------------------------------------------------------*/
+#ifndef HOSTIO_H
+#define HOSTIO_H
+
+#include <stdint.h>
+
+#ifndef F_CPU
+#define F_CPU               16000000UL
+#endif
+
+#define _BV(bit)            (1U << (bit))
+
+/* Timer1, sample timer */
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+extern volatile uint16_t TCNT1, OCR1A;
+#define WGM12               3
+#define CS10                0
+#define CS11                1
+#define CS12                2
+#define OCIE1A              1
+
+/* Timer2, PWM generation */
+extern volatile uint8_t TCCR2A, TCCR2B, TIMSK2, TCNT2, OCR2B;
+#define WGM20               0
+#define WGM21               1
+#define COM2B1              5
+#define CS20                0
+
+/* I/O ports */
+extern volatile uint8_t DDRD;
+#define PD3                 3
+
+/* status register and interrupts */
+extern volatile uint8_t SREG;
+#define SREG_I              7
+
+#define sei()               (SREG |= (uint8_t)_BV(SREG_I))
+#define cli()               (SREG &= (uint8_t)~_BV(SREG_I))
+#define ISR(vector)         void vector(void)
+
+void TIMER1_COMPA_vect(void);
+
+/* program memory, a single address space on the host */
+#define PROGMEM
+#define pgm_read_byte(p)    (*(const uint8_t*)(p))
+#define pgm_read_word(p)    (*(const uint16_t*)(p))
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * simulated clock
+ */
+
+/* CPU cycles elapsed since the start of the simulation */
+extern uint64_t host_cycles;
+
+/* CPU cycles taken by the sample timer interrupt, stolen from the main loop */
+extern uint16_t host_isr_cycles;
+
+/* longest time between two busy loop iterations of the player while the
+ * sample timer runs, that is the worst refill latency
+ */
+extern uint32_t host_busy_max;
+
+/* reset the peripherals and the clock */
+void host_reset(void);
+
+/* let the time pass, raising the pending interrupts */
+void host_advance(uint32_t cycles);
+
+/* called by the busy loops of the player, jumps to the next interrupt */
+void host_idle(void);
+
+/* CPU cycles spent by the player on the sample conversions */
+extern uint64_t host_work_cycles;
+
+/* charge CPU work of the player to the clock */
+void host_work(uint32_t cycles);
+
+/* sample sink, called with the PWM value at every sample timer tick */
+extern void (*host_sink)(uint8_t sample);
+
+#endif
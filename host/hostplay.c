@@ -0,0 +1,123 @@
+/* hostplay.c
+ *
+ * Play the WAV directory of a FAT disk image on
+ * the build machine, through the same pff and
+ * playwaveutils code as the target, or the tracks
+ * of its PLAYLIST.IDX file as main() does. Samples
+ * are written as raw 8-bit unsigned PCM.
+ *
+ * usage : hostplay <disk image> [output file]
+ */
+#include <stdio.h>
+#include "pff.h"
+#include "playwaveutils.h"
+#include "hostdisk.h"
+
+FATFS fs;
+DIR dir;
+FILINFO fno;
+
+static FILE* out;
+static uint32_t nsamples;
+
+static void write_sample(uint8_t sample)
+{
+    if(out) fputc(sample, out);
+    nsamples++;
+}
+
+/* play the open file, n : load_header() or index_load() result */
+static int play(uint32_t n)
+{
+    uint64_t start;
+
+    if(n < 1024)
+    {
+        printf("can't play file.\n");
+        return 0;
+    }
+
+    nsamples = 0;
+    start = host_cycles;
+    if(playback())
+    {
+        printf("error while playing.\n");
+        return 1;
+    }
+    printf("%lu samples%s, %.3f s%s\n", (unsigned long)nsamples, nsamples == n ? "" : " (header : other count)",
+        (double)(host_cycles - start) / F_CPU, (fs.flag & FA_CONTIG) ? ", contiguous" : "");
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    FRESULT res = FR_OK;
+    uint16_t i, n;
+    uint32_t r;
+    PLAYHEALTH health;
+    int err = 0;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage : %s <disk image> [output file]\n", argv[0]);
+        return 2;
+    }
+    if(host_disk_open(argv[1]))
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    if(argc > 2 && !(out = fopen(argv[2], "wb")))
+    {
+        perror(argv[2]);
+        return 1;
+    }
+    host_sink = write_sample;
+
+    res = pf_mount(&fs);
+    if(res != FR_OK)
+    {
+        printf("Cannot mount disk image (%d).\n", res);
+        return 1;
+    }
+    if((n = index_open()) != 0)
+    {
+        printf("%s : %u tracks\n", INDEX_PATH, n);
+        for(i = 0; i < n; i++)
+        {
+            r = index_load(i, fno.fname);
+            printf("%-12s ", fno.fname);
+            err |= play(r);
+        }
+    }
+    else
+    {
+        res = pf_opendir(&dir, "WAV");
+        if(res != FR_OK)
+        {
+            printf("Unable to open WAV directory (%d).\n", res);
+            return 1;
+        }
+
+        for(;;)
+        {
+            res = pf_readdir(&dir, &fno);
+            if(res != FR_OK || fno.fname[0] == '\0') break;
+
+            printf("%-12s ", fno.fname);
+            res = pf_openentry(&fno);
+            err |= play(res == FR_OK ? load_header() : 0);
+        }
+    }
+
+    playback_health(&health, 0);
+    printf("health : %u underruns, refill max %u ticks, %u stalls, %u disk errors\n", health.underruns,
+        health.refill_max, health.stalls, health.disk_errors);
+    printf("disk : %lu reads, %lu commands, %lu bytes clocked\n", (unsigned long)host_disk.reads,
+        (unsigned long)host_disk.commands, (unsigned long)host_disk.bytes);
+
+    if(out) fclose(out);
+    host_disk_close();
+
+    return err || res != FR_OK;
+}
@@ -0,0 +1,52 @@
+/* mkfatimg.c
+ *
+ * Generate a FAT test image with a WAV directory
+ * of LPCM, IMA ADPCM or G.711 files, see fatimg.h.
+ *
+ * usage : mkfatimg [-t 16|32] [-c sectors per cluster] [-f clusters per fragment]
+ *                  [-n files] [-s samples per file] [-r sample frequency]
+ *                  [-m metadata chunk size] [-b 4|8|16] [-C 1|2] [-g 6|7] [-x (playlist index)] <image>
+ */
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "fatimg.h"
+
+int main(int argc, char* argv[])
+{
+    FATIMG conf = {16, 4, 0, 2, 80000, 8000, 0, 8, 1, 0, 0};
+    int opt;
+
+    while((opt = getopt(argc, argv, "t:c:f:n:s:r:m:b:C:g:x")) != -1)
+    {
+        switch(opt)
+        {
+            case 't': conf.fat_type = (uint8_t)atoi(optarg); break;
+            case 'c': conf.csize = (uint8_t)atoi(optarg); break;
+            case 'f': conf.frag = (uint16_t)atoi(optarg); break;
+            case 'n': conf.nfiles = (uint8_t)atoi(optarg); break;
+            case 's': conf.nsamples = (uint32_t)atol(optarg); break;
+            case 'r': conf.freq = (uint32_t)atol(optarg); break;
+            case 'm': conf.meta = (uint16_t)atoi(optarg); break;
+            case 'b': conf.bits = (uint8_t)atoi(optarg); break;
+            case 'C': conf.channels = (uint8_t)atoi(optarg); break;
+            case 'g': conf.g711 = (uint8_t)atoi(optarg); break;
+            case 'x': conf.index = 1; break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if(optind != argc - 1)
+    {
+        fprintf(stderr, "usage : %s [-t 16|32] [-c sectors per cluster] [-f clusters per fragment]\n"
+            "       [-n files] [-s samples per file] [-r sample frequency] [-m metadata chunk size] [-b 4|8|16] [-C 1|2] [-g 6|7] [-x] <image>\n", argv[0]);
+        return 2;
+    }
+
+    if(fatimg_create(argv[optind], &conf))
+    {
+        fprintf(stderr, "%s : can't create the image\n", argv[optind]);
+        return 1;
+    }
+    return 0;
+}
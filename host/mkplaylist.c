@@ -0,0 +1,117 @@
+/* mkplaylist.c
+ *
+ * Write the playlist index of the WAV directory of
+ * a card (a disk image or a block device), read
+ * through the same pff and playwaveutils code as
+ * the target. The output is copied to the root
+ * directory of the card as PLAYLIST.IDX, which
+ * doesn't move the files already written.
+ * Files which can't be played are left out.
+ *
+ * usage : mkplaylist <disk image> <index file>
+ */
+#include <stdio.h>
+#include <string.h>
+#include "pff.h"
+#include "playwaveutils.h"
+#include "hostdisk.h"
+
+#define MAX_TRACKS  1024
+
+FATFS fs;
+DIR dir;
+FILINFO fno;
+
+static uint8_t idx[INDEX_HEADER_SIZE + MAX_TRACKS * TRACK_SIZE];
+
+static void st_word(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void st_dword(uint8_t* p, uint32_t v)
+{
+    st_word(p, (uint16_t)v);
+    st_word(p + 2, (uint16_t)(v >> 16));
+}
+
+int main(int argc, char* argv[])
+{
+    FRESULT res;
+    FILE* out;
+    uint8_t* t;
+    uint16_t n = 0;
+
+    if(argc != 3)
+    {
+        fprintf(stderr, "usage : %s <disk image> <index file>\n", argv[0]);
+        return 2;
+    }
+    if(host_disk_open(argv[1]))
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    res = pf_mount(&fs);
+    if(res != FR_OK)
+    {
+        printf("Cannot mount disk image (%d).\n", res);
+        return 1;
+    }
+    res = pf_opendir(&dir, "WAV");
+    if(res != FR_OK)
+    {
+        printf("Unable to open WAV directory (%d).\n", res);
+        return 1;
+    }
+
+    for(;;)
+    {
+        res = pf_readdir(&dir, &fno);
+        if(res != FR_OK || fno.fname[0] == '\0') break;
+
+        if(pf_openentry(&fno) != FR_OK || load_header() < 1024)
+        {
+            printf("%-12s skipped\n", fno.fname);
+            continue;
+        }
+        if(n == MAX_TRACKS)
+        {
+            printf("more than %u tracks\n", MAX_TRACKS);
+            break;
+        }
+
+        t = idx + INDEX_HEADER_SIZE + n++ * TRACK_SIZE;
+        memcpy(t + TRACK_NAME, fno.fname, strlen(fno.fname));     /* up to 12 characters */
+        st_dword(t + TRACK_CLUST, fs.org_clust);
+        st_dword(t + TRACK_DATA_OFS, wav.data_ofs);
+        st_dword(t + TRACK_DATA_SIZE, wav.data_size);
+        st_word(t + TRACK_FREQ, (uint16_t)wav.freq);
+        st_word(t + TRACK_FORMAT, wav.format);
+        t[TRACK_CHANNELS] = (uint8_t)wav.channels;
+        t[TRACK_BITS] = (uint8_t)wav.bits;
+        st_word(t + TRACK_BLOCK_ALIGN, wav.block_align);
+        printf("%-12s cluster %lu, %lu bytes at %lu, %lu Hz\n", fno.fname, (unsigned long)fs.org_clust,
+            (unsigned long)wav.data_size, (unsigned long)wav.data_ofs, (unsigned long)wav.freq);
+    }
+    host_disk_close();
+    if(res != FR_OK)
+    {
+        printf("Directory read error (%d).\n", res);
+        return 1;
+    }
+
+    memcpy(idx + INDEX_ID, "WIDX", 4);
+    st_word(idx + INDEX_VER, INDEX_VERSION);
+    st_word(idx + INDEX_COUNT, n);
+    out = fopen(argv[2], "wb");
+    if(!out || fwrite(idx, INDEX_HEADER_SIZE + (size_t)n * TRACK_SIZE, 1, out) != 1 || fclose(out))
+    {
+        perror(argv[2]);
+        return 1;
+    }
+    printf("%u tracks\n", n);
+    return 0;
+}
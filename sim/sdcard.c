@@ -0,0 +1,183 @@
+/*---------------------------------------------------------------------------/
+/ sdcard - SD card model on the SPI bus of the simulated AVR
+/----------------------------------------------------------------------------*/
+#define _XOPEN_SOURCE 700
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "sdcard.h"
+
+#define R1_IDLE         0x01
+#define R1_ILLEGAL      0x04
+#define R1_PARAM        0x40
+#define DATA_TOKEN      0xFE
+
+static uint32_t nsectors;
+
+int sdcard_open(SDCARD* card, const char* path)
+{
+    struct stat st;
+
+    memset(card, 0, sizeof(*card));
+    card->image = fopen(path, "rb");
+    if(!card->image || fstat(fileno(card->image), &st)) return 1;
+    nsectors = (uint32_t)(st.st_size / 512);
+    card->idle = 1;
+    card->init_polls = 2;
+    card->nac = 100;
+    card->busy = 8;
+    return 0;
+}
+
+void sdcard_close(SDCARD* card)
+{
+    if(card->image) fclose(card->image);
+    card->image = NULL;
+}
+
+void sdcard_cs(SDCARD* card, uint8_t level)
+{
+    card->selected = !level;
+    card->ncmd = 0;     /* a partial frame is dropped, a block transfer goes on */
+}
+
+/* queue a response, after one byte of command response time (Ncr) */
+static void respond(SDCARD* card, const uint8_t* r, uint8_t n)
+{
+    card->resp[0] = 0xFF;
+    memcpy(card->resp + 1, r, n);
+    card->nresp = (uint8_t)(n + 1);
+    card->iresp = 0;
+}
+
+static void start_read(SDCARD* card, uint32_t sector, uint32_t blocks)
+{
+    uint8_t r1 = 0x00;
+
+    if(sector >= nsectors)
+    {
+        card->errors++;
+        r1 = R1_PARAM;
+    }
+    else
+    {
+        card->sector = sector;
+        card->blocks = blocks;
+        card->pos = 0;
+    }
+    respond(card, &r1, 1);
+}
+
+static void command(SDCARD* card)
+{
+    uint8_t index = card->cmd[0] & 0x3F, acmd = card->acmd;
+    uint32_t arg = ((uint32_t)card->cmd[1] << 24) | ((uint32_t)card->cmd[2] << 16)
+        | ((uint32_t)card->cmd[3] << 8) | card->cmd[4];
+    uint8_t r[14], n;
+
+    card->commands++;
+    card->acmd = 0;
+    r[0] = card->idle ? R1_IDLE : 0x00;
+    switch(index)
+    {
+        case 0:     /* GO_IDLE_STATE */
+            card->idle = 1;
+            card->blocks = 0;
+            respond(card, (const uint8_t[]){ R1_IDLE }, 1);
+            break;
+        case 8:     /* SEND_IF_COND, 2.7-3.6V, check pattern echoed */
+            r[1] = r[2] = 0x00;
+            r[3] = card->cmd[3];
+            r[4] = card->cmd[4];
+            respond(card, r, 5);
+            break;
+        case 55:    /* APP_CMD */
+            card->acmd = 1;
+            respond(card, r, 1);
+            break;
+        case 41:    /* SD_SEND_OP_COND */
+            if(!acmd)
+            {
+                card->errors++;
+                r[0] |= R1_ILLEGAL;
+            }
+            else if(card->init_polls) card->init_polls--;
+            else r[0] = card->idle = 0;
+            respond(card, r, 1);
+            break;
+        case 58:    /* READ_OCR : powered up, CCS (block addressing) */
+            r[1] = 0xC0;
+            r[2] = 0xFF;
+            r[3] = 0x80;
+            r[4] = 0x00;
+            respond(card, r, 5);
+            break;
+        case 16:    /* SET_BLOCKLEN */
+            respond(card, r, 1);
+            break;
+        case 17:    /* READ_SINGLE_BLOCK */
+            start_read(card, arg, 1);
+            break;
+        case 18:    /* READ_MULTIPLE_BLOCK */
+            start_read(card, arg, UINT32_MAX);
+            break;
+        case 12:    /* STOP_TRANSMISSION : stuff byte, R1, then busy */
+            card->blocks = 0;
+            n = card->busy < sizeof(r) - 2 ? (uint8_t)card->busy : (uint8_t)(sizeof(r) - 2);
+            r[0] = 0xFF;
+            r[1] = 0x00;
+            memset(r + 2, 0x00, n);
+            respond(card, r, (uint8_t)(n + 2));
+            break;
+        default:
+            card->errors++;
+            r[0] |= R1_ILLEGAL;
+            respond(card, r, 1);
+            break;
+    }
+}
+
+/* next byte of the block frame being streamed */
+static uint8_t stream(SDCARD* card)
+{
+    uint16_t pos = card->pos++;
+
+    if(pos < card->nac) return 0xFF;
+    if(pos == card->nac)
+    {
+        if(pread(fileno(card->image), card->data, 512, (off_t)card->sector * 512) != 512)
+            card->errors++;
+        return DATA_TOKEN;
+    }
+    if(pos <= card->nac + 512U) return card->data[pos - card->nac - 1];
+    if(pos == card->nac + 514U)    /* second CRC byte, end of the block */
+    {
+        card->pos = 0;
+        card->sector++;
+        if(card->blocks != UINT32_MAX) card->blocks--;
+        if(card->sector >= nsectors) card->blocks = 0;
+    }
+    return 0xFF;    /* CRC, not checked by the host */
+}
+
+uint8_t sdcard_spi(SDCARD* card, uint8_t mosi)
+{
+    uint8_t miso = 0xFF;
+
+    if(!card->selected) return 0xFF;
+
+    if(card->iresp < card->nresp) miso = card->resp[card->iresp++];
+    else if(card->blocks) miso = stream(card);
+
+    /* command frames start with 01xxxxxx */
+    if(card->ncmd || (mosi & 0xC0) == 0x40)
+    {
+        card->cmd[card->ncmd++] = mosi;
+        if(card->ncmd == sizeof(card->cmd))
+        {
+            card->ncmd = 0;
+            command(card);
+        }
+    }
+    return miso;
+}
@@ -0,0 +1,45 @@
+/*---------------------------------------------------------------------------/
+/ sdcard - SD card model on the SPI bus of the simulated AVR
+/
+/ An SDHC card in SPI mode, backed by a disk image : the commands issued by
+/ avr_mmcp.c (CMD0, CMD8, ACMD41, CMD58, CMD16, CMD17, CMD18, CMD12) are
+/ answered byte by byte, every byte the firmware clocks gets the MISO byte
+/ of the card. Data blocks are preceded by nac bytes of access time.
+/----------------------------------------------------------------------------*/
+#ifndef SDCARD_H
+#define SDCARD_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct {
+    FILE*       image;
+    uint8_t     selected;       /* chip select asserted (low) */
+    uint8_t     cmd[6];         /* command frame being received */
+    uint8_t     ncmd;
+    uint8_t     idle;           /* in idle state, until ACMD41 completes */
+    uint8_t     acmd;           /* the previous command was CMD55 */
+    uint8_t     init_polls;     /* ACMD41 answered busy before the card is ready */
+    uint8_t     resp[16];       /* response bytes to be clocked out */
+    uint8_t     nresp, iresp;
+    uint32_t    blocks;         /* blocks left to stream, 0 : none, UINT32_MAX : up to CMD12 */
+    uint32_t    sector;         /* block being streamed */
+    uint16_t    pos;            /* byte of the block frame : access time, token, data, CRC */
+    uint16_t    nac;            /* access time before a data token, in bytes */
+    uint16_t    busy;           /* busy bytes after CMD12 */
+    uint8_t     data[512];
+    uint32_t    commands;       /* commands received */
+    uint32_t    errors;         /* illegal commands or out of range blocks */
+} SDCARD;
+
+/* open the card on the disk image, 0 : success */
+int sdcard_open(SDCARD* card, const char* path);
+void sdcard_close(SDCARD* card);
+
+/* chip select level, 0 : selected */
+void sdcard_cs(SDCARD* card, uint8_t level);
+
+/* byte exchange : mosi is the byte sent by the AVR, the card byte is returned */
+uint8_t sdcard_spi(SDCARD* card, uint8_t mosi);
+
+#endif
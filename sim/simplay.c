@@ -0,0 +1,268 @@
+/* simplay.c
+ *
+ * Run the firmware in simavr, with an SD card model
+ * on the SPI pins backed by a disk image generated
+ * by fatimg, and check the samples it plays against
+ * the file content, fatimg_sample() of every file of
+ * the WAV directory in turn (8-bit mono files) :
+ * - the values written to OCR2B by the sample timer
+ *   interrupt are these samples, in order,
+ * - every interrupt writes a sample while the reference
+ *   is played (no underrun),
+ * - every sample is written less than a sample period
+ *   after its Timer1 compare match, the interrupt entry
+ *   times being checked against the OCR1A period.
+ * The firmware runs until it reports the end of the
+ * playlist on the USART, which is echoed.
+ *
+ * usage : simplay [-T seconds] [-t 16|32] [-c sectors per cluster] [-f clusters per fragment]
+ *                 [-n files] [-s samples per file] [-r sample frequency] [-m metadata chunk size]
+ *                 <firmware.elf> <disk image>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+#include "sim_irq.h"
+#include "sim_interrupts.h"
+#include "avr_spi.h"
+#include "avr_ioport.h"
+#include "avr_uart.h"
+#include "sdcard.h"
+#include "fatimg.h"
+
+#define MCU                 "atmega328p"
+#define FREQUENCY           16000000UL
+#define TIMER1_COMPA_VECTOR 11
+#define OCR1AL_ADDR         0x88
+#define OCR1AH_ADDR         0x89
+#define OCR2B_ADDR          0xB4
+#define SPI_CS_PIN          2           /* PB2 */
+#define END_MESSAGE         "entirely played"
+#define END_DELAY           (FREQUENCY / 5) /* health report, about 80 characters at 9600 baud */
+
+static avr_t* avr;
+static SDCARD card;
+static avr_irq_t* spi_in;
+
+static uint8_t* ref;                /* expected samples, the files played in turn */
+static uint32_t nref;
+
+/* sample check */
+static uint32_t nplayed;            /* samples written by the interrupt */
+static uint32_t differ, first_differ = UINT32_MAX;
+static uint32_t underruns;
+static uint32_t late;               /* samples written a period or more after their compare */
+static uint32_t ticks;              /* interrupts */
+
+/* interrupt timing */
+static uint8_t in_isr, written;
+static avr_cycle_count_t entry, last_entry, nominal;
+static uint16_t period;             /* OCR1A + 1 */
+static int64_t lat_min, lat_max;    /* entry time, relative to the nominal compare times */
+static avr_cycle_count_t isr_max, write_max;
+
+/* bus */
+static avr_cycle_count_t spi_last, spi_min = (avr_cycle_count_t)-1;
+
+/* USART */
+static char line[128];
+static uint8_t nline;
+static avr_cycle_count_t stop_at;
+
+static void spi_out(struct avr_irq_t* irq, uint32_t value, void* param)
+{
+    (void)irq; (void)param;
+    if(card.selected && spi_last && avr->cycle - spi_last < spi_min) spi_min = avr->cycle - spi_last;
+    spi_last = avr->cycle;
+    avr_raise_irq(spi_in, sdcard_spi(&card, (uint8_t)value));
+}
+
+static void cs_change(struct avr_irq_t* irq, uint32_t value, void* param)
+{
+    (void)irq; (void)param;
+    sdcard_cs(&card, (uint8_t)(value & 1));
+    spi_last = 0;
+}
+
+static void uart_out(struct avr_irq_t* irq, uint32_t value, void* param)
+{
+    (void)irq; (void)param;
+    putchar((int)value);
+    if(value != '\n' && nline < sizeof(line) - 1)
+    {
+        line[nline++] = (char)value;
+        return;
+    }
+    line[nline] = '\0';
+    nline = 0;
+    if(!stop_at && strstr(line, END_MESSAGE)) stop_at = avr->cycle + END_DELAY;
+}
+
+/* entry and exit of the sample timer interrupt */
+static void isr_running(struct avr_irq_t* irq, uint32_t value, void* param)
+{
+    avr_cycle_count_t t = avr->cycle;
+    uint16_t p = (uint16_t)(avr->data[OCR1AL_ADDR] | (avr->data[OCR1AH_ADDR] << 8)) + 1U;
+    int64_t lat;
+
+    (void)irq; (void)param;
+    if(value)
+    {
+        if(!ticks || p != period || t - last_entry > 2U * p)
+        {
+            nominal = t;    /* first compare, new rate or restarted timer */
+            period = p;
+        }
+        else
+        {
+            nominal += period;
+            lat = (int64_t)(t - nominal);
+            if(lat < lat_min) lat_min = lat;
+            if(lat > lat_max) lat_max = lat;
+        }
+        last_entry = entry = t;
+        in_isr = 1;
+        written = 0;
+        ticks++;
+    }
+    else if(in_isr)
+    {
+        in_isr = 0;
+        if(t - entry > isr_max) isr_max = t - entry;
+        if(!written && nplayed && nplayed < nref) underruns++;
+    }
+}
+
+static void ocr2b_write(struct avr_t* a, avr_io_addr_t addr, uint8_t v, void* param)
+{
+    avr_cycle_count_t lateness;
+
+    (void)a; (void)addr; (void)param;
+    if(!in_isr) return;     /* PWM_start() */
+    written = 1;
+    if(nplayed < nref && v != ref[nplayed])
+    {
+        if(!differ) first_differ = nplayed;
+        differ++;
+    }
+    nplayed++;
+
+    lateness = avr->cycle - nominal;
+    if(lateness > write_max) write_max = lateness;
+    if(lateness >= period) late++;
+}
+
+/* the samples of the files of the image, in directory order */
+static int make_reference(const FATIMG* conf)
+{
+    uint32_t i;
+    uint8_t f;
+
+    nref = conf->nsamples * conf->nfiles;
+    ref = malloc(nref + 1);
+    if(!ref) return 1;
+    for(f = 0; f < conf->nfiles; f++)
+        for(i = 0; i < conf->nsamples; i++)
+            ref[f * conf->nsamples + i] = fatimg_sample(f, i);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    FATIMG conf = {32, 1, 1, 3, 20000, 22050, 0, 8, 1, 0, 0};
+    elf_firmware_t fw;
+    avr_cycle_count_t limit;
+    uint32_t flags = 0;
+    unsigned timeout = 0;
+    int opt, state, ok;
+
+    while((opt = getopt(argc, argv, "T:t:c:f:n:s:r:m:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'T': timeout = (unsigned)atoi(optarg); break;
+            case 't': conf.fat_type = (uint8_t)atoi(optarg); break;
+            case 'c': conf.csize = (uint8_t)atoi(optarg); break;
+            case 'f': conf.frag = (uint16_t)atoi(optarg); break;
+            case 'n': conf.nfiles = (uint8_t)atoi(optarg); break;
+            case 's': conf.nsamples = (uint32_t)atol(optarg); break;
+            case 'r': conf.freq = (uint32_t)atol(optarg); break;
+            case 'm': conf.meta = (uint16_t)atoi(optarg); break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if(argc - optind != 2)
+    {
+        fprintf(stderr, "usage : %s [-T seconds] [-t 16|32] [-c sectors per cluster] [-f clusters per fragment]\n"
+            "       [-n files] [-s samples per file] [-r sample frequency] [-m metadata chunk size] <firmware.elf> <disk image>\n", argv[0]);
+        return 2;
+    }
+    if(fatimg_create(argv[optind + 1], &conf) || make_reference(&conf))
+    {
+        fprintf(stderr, "%s : can't create the image\n", argv[optind + 1]);
+        return 2;
+    }
+    if(sdcard_open(&card, argv[optind + 1]))
+    {
+        perror(argv[optind + 1]);
+        return 2;
+    }
+
+    memset(&fw, 0, sizeof(fw));
+    if(elf_read_firmware(argv[optind], &fw))
+    {
+        fprintf(stderr, "%s : can't load the firmware\n", argv[optind]);
+        return 2;
+    }
+    avr = avr_make_mcu_by_name(fw.mmcu[0] ? fw.mmcu : MCU);
+    if(!avr)
+    {
+        fprintf(stderr, "%s : unknown MCU\n", fw.mmcu[0] ? fw.mmcu : MCU);
+        return 2;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &fw);
+    if(!avr->frequency) avr->frequency = FREQUENCY;
+
+    spi_in = avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_INPUT);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_OUTPUT), spi_out, NULL);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), SPI_CS_PIN), cs_change, NULL);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), uart_out, NULL);
+    avr_irq_register_notify(avr_get_interrupt_irq(avr, TIMER1_COMPA_VECTOR) + AVR_INT_IRQ_RUNNING, isr_running, NULL);
+    avr_register_io_write(avr, OCR2B_ADDR, ocr2b_write, NULL);
+
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);    /* the USART is echoed here */
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+
+    /* the files played at 8kHz, plus the card initialization */
+    limit = (avr_cycle_count_t)(timeout ? timeout : nref / 8000U + 5U) * avr->frequency;
+    do
+    {
+        state = avr_run(avr);
+    } while(state != cpu_Done && state != cpu_Crashed && avr->cycle < limit
+            && !(stop_at && avr->cycle >= stop_at));
+
+    printf("\nsamples : %lu played of %lu, %lu differ", (unsigned long)nplayed, (unsigned long)nref, (unsigned long)differ);
+    if(differ) printf(" (first at %lu)", (unsigned long)first_differ);
+    printf(", %lu underruns\n", (unsigned long)underruns);
+    printf("timing  : %lu interrupts, entry jitter %ld cycles, interrupt up to %lu cycles, "
+        "sample written up to %lu cycles after its compare (period %u), %lu late\n",
+        (unsigned long)ticks, (long)(lat_max - lat_min), (unsigned long)isr_max,
+        (unsigned long)write_max, period, (unsigned long)late);
+    printf("card    : %lu commands, %lu errors, a byte every %lu cycles at best\n",
+        (unsigned long)card.commands, (unsigned long)card.errors, (unsigned long)spi_min);
+    if(state == cpu_Crashed) printf("firmware crashed at %lu cycles\n", (unsigned long)avr->cycle);
+    else if(!stop_at) printf("no end of playlist after %lu cycles\n", (unsigned long)avr->cycle);
+
+    ok = state != cpu_Crashed && stop_at && nplayed >= nref && !differ && !underruns && !late && !card.errors;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+
+    sdcard_close(&card);
+    avr_terminate(avr);
+    return !ok;
+}
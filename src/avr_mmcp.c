@@ -1,484 +1,995 @@
-/*-----------------------------------------------------------------------
- * Low level disk I/O module for Petit FatFs (C)ChaN, 2014 
- * 
- * Designed for ATmega328P using SPI interface
- * 
- * Author   : Hugo Schaaf
- * date     : 05/2019 
- * 
- * v2.2.3
- *-----------------------------------------------------------------------*/
-
-#include "diskio.h"
-#include <avr/io.h>
-#include <util/delay.h>
-
-/* SPI pin definition 						*/
-/* here are specifications for atmega328p ! */
-#ifndef SPI_DDR
-	#define SPI_DDR		DDRB
-#endif
-#ifndef SPI_PORT
-	#define SPI_PORT 	PORTB
-#endif
-#ifndef SPI_CS
-	#define SPI_CS		PB2
-#endif
-#ifndef SPI_MOSI
-	#define SPI_MOSI	PB3
-#endif
-#ifndef SPI_MISO
-	#define SPI_MISO	PB4
-#endif
-#ifndef SPI_SCK
-	#define SPI_SCK		PB5
-#endif
-
-/* Chip Select (CS) control */
-#ifndef SELECT()
-	#define SELECT()	SPI_PORT &= (uint8_t)(~_BV(SPI_CS))
-#endif
-#ifndef DESELECT()
-	#define DESELECT()	SPI_PORT |= (uint8_t)_BV(SPI_CS)
-#endif
-#ifndef IS_SELECTED()
-	#define IS_SELECTED() (SPI_PORT & _BV(SPI_CS))
-#endif
-
-/* SD/MMC SPI command set definiton */
-/* MSByte of a command frame -> 0 1 index[5:0]
- * so b7:b6 01 stands for 0x40
- */
-#define GO_IDLE 			(0x40 + 0)  /* CMD0 */
-#define INIT 				(0x40 + 1)  /* CMD1 */
-#define APP_INIT 			(0xC0 + 41) /* ACMD41, 1st bit set artificially to reconize acmd further */
-#define CHECK_V 			(0x40 + 8)  /* CMD8 */
-#define STOP_READ 			(0x40 + 12) /* CMD12 */
-#define SET_BLOCKLEN 		(0x40 + 16) /* CMD16 */
-#define READ_SINGLE_BLOCK 	(0x40 + 17) /* CMD17 */
-#define READ_MULTI_BLOCK 	(0x40 + 18) /* CMD18 */
-#define WRITE_SINGLE_BLOCK 	(0x40 + 24) /* CMD24 */
-#define WRITE_MULTI_BLOCK 	(0x40 + 25) /* CMD25 */
-#define ACMD_LEADING 		(0x40 + 55) /* CMD55 */
-#define READ_OCR 			(0x40 + 58) /* CMD58 */
-#define IS_ACMD(cmd)		(cmd & 0x80)/* test is this is an ACMD command */
-#define ACMD_MASK			0x7F		/* retrieve the following command of ACMD suite */	
-
-/* R1 response flags */
-#define IN_IDLE_STATE		0x01
-#define ERASE_RESET			0x02
-#define ILLEGAL_CMD			0x04
-#define CMD_CRC_ERR			0x08
-#define ERASE_SEQ_ERR		0x10
-#define ADDRESS_ERR			0x20
-#define PARAM_ERR			0x40
-#define IS_R1_RESP(i)		((i & 0x80)==0)
-
-/* Data Token */
-#define D_TOK1 				0xFE /* token for CMD17/18/24 */
-#define D_TOK2				0xFC /* token for CMD25 */
-#define STP_TRAN_TOK		0xFD /* stop transmission token for CDM25 */
-
-/* Flags definitions in command responses */
-#define HCS_SET				0x40000000UL
-#define CCS_SET				0x40000000UL
-
-/* Data responses flags */
-#define DATA_RESP_MASK		0x0F
-#define DATA_ACCEPTED		0x05
-#define DATA_CRC_ERR		0x0B
-#define DATA_WRITE_ERR		0x0D
-
-/* extreme values */
-#define DATA_MAX_SIZE		512	/* max number of bytes to read or write */
-
-/* valid CRC fields + 1 terminating bit
- * if CMD0 or CMD8, CRC must be correct so add CRC
- * CRC calculator : 
- * http://www.ghsi.de/pages/subpages/Online%20CRC%20Calculation/
- * with polynom : 10001001
- * CRC 7bits + 1 (LSB) to from a byte so 
- * i = (CRC<<1)+1
- */
-#define GO_IDLE_CRC			0x95
-#define CHECK_V_CRC			0X87
-
-/* Card types identification */
-#define CT_UNKNOWN			0x00 /* byte adress for these cases */
-#define CT_SDC1				0x01 /*-                            */
-#define CT_SDC2				0x02 /*-                            */
-#define CT_MMC3				0x04 /*-                            */
-#define CT_BLOCK			0x08 /* block adress read/write in this case */
-
-/* just to avoid trouble - forward data to the outgoing stream */
-#define FORWARD(d)
-
-static uint8_t cardType;
-
-/*------------------------------------*/
-/* Prototypes for spi control, mode 0 */
-
-
-/* void init_spi(void)
- *
- * SPI initialization
- * Enable SPI as master, interrupts disabled, MSB transmitted first
- * mode 0 and 64 clock prescaling (supposing clk -> 16 MHz so spi clk running at 250kHz)
- */
-static inline
-void init_spi(void)
-{
-	/* data direction settings first, to avoid automatic slave switching */
-	SPI_DDR |= (uint8_t)(_BV(SPI_MOSI) | _BV(SPI_CS) | _BV(SPI_SCK));	/* select data direction, 
-															   SPI_MISO is overriden as an input */
-	SPI_PORT |= (uint8_t)(_BV(SPI_MISO) | _BV(SPI_SCK) );	/* enable pullup resistor on MISO */
-
-	PRR &= (uint8_t)(~_BV(PRSPI));	/* exit from power reduction mode to be able to enable SPI */
-	SPSR &= (uint8_t)(~_BV(SPI2X));	/* disable spi double speed */
-	SPCR = (uint8_t)(_BV(SPE) | _BV(MSTR) | _BV(SPR1) | _BV(SPR0));
-}
-
-/* void spi_set_rw_speed(void)
- *
- * Change the SPI clock frequency
- * assuming F_CPU is 16MHz, should not exceed
- * 20-25MHz.
- * SCK -> 16MHz/2 = 8MHz
- */
-static inline
-void spi_set_rw_speed(void)
-{
-	SPCR &= (uint8_t)( ~(_BV(SPR1) | _BV(SPR0)) );	/* clear previous speed config */
-	SPSR |= (uint8_t)_BV(SPI2X);	/* set SCK freq = F_CPU/2 */
-}
-
-static inline
-uint8_t spi(uint8_t data)
-{	
-	SPDR = data;
-	while( !(SPSR & (uint8_t)(_BV(SPIF))) )
-	{;;}
-	return (uint8_t)SPDR;
-}
-
-static inline
-uint8_t rx_spi(void)
-{
-	return spi(0xFF);
-}
-
-static inline
-void tx_spi(uint8_t data)
-{
-	spi(data);
-}
-
-static inline
-uint8_t waitNotBusy(uint16_t timeout)
-{
-	for(;timeout>0 && rx_spi()==0xFF; timeout--)
-	{ 	_delay_ms(1); }
-	return timeout>0;
-}
-
-
-/*-----------------------------------------*/
-/* Prototypes for SDC/MMC SPI mode control */
-
-/*-------------------------------------------*/
-/* uint8_t send_cmd(uint8_t cmd, uint32_t arg)
- *
- * send a command to the drive. 
- * After sending a command, the drive is 
- * still selected (eg CS low). No need to
- * re-select the drive after having send a
- * command !
- */
-
-static uint8_t send_cmd(uint8_t cmd, uint32_t arg)
-{
-	uint8_t i = 0xFF, result = 0x00;	/* i : dummy CRC and Stop */
-
-	if(IS_ACMD(cmd))	/* if ACMD<n> command */
-	{
-		result = send_cmd(ACMD_LEADING, 0);
-		cmd &= ACMD_MASK;	/* clear the MSB artificially set to retrieve 
-					   	   the ACMD command index */
-		if(result>1)
-		{
-			return result;
-		}
-	}
-
-	/* give some extra clocks to the card and select it */
-	DESELECT();
-	rx_spi();
-	SELECT();
-	rx_spi();
-
-	tx_spi(cmd);
-	tx_spi((uint8_t)(arg >> 24));
-	tx_spi((uint8_t)(arg >> 16));
-	tx_spi((uint8_t)(arg >> 8));
-	tx_spi((uint8_t)arg);
-
-	if(cmd == GO_IDLE)
-	{
-		i = GO_IDLE_CRC;
-	}
-	if(cmd == CHECK_V)
-	{
-		i = CHECK_V_CRC;
-	}
-
-	tx_spi(i);
-
-	if (cmd == STOP_READ)
-	{
-			result = rx_spi();	/* Receive stuff byte */
-	}
-
-	/* get the response to the command, 10 attempts. Maximum waiting time can be up to 8 dummy bytes */
-	i=10;
-	do
-	{
-		result = rx_spi();
-	}while( !IS_R1_RESP(result) && i--);
-
-	return result;
-}
-
-
-/*-----------------------------------------------------------------------*/
-/* Initialize Disk Drive                                                 */
-/*-----------------------------------------------------------------------*/
-
-DSTATUS disk_initialize (void)
-{
-	uint8_t ocr[4]={0};
-	uint16_t notimeout=0;	/*	notimeout == 0	-> timeout reached
-						 	 *	notimeout > 0	-> timeout not reached
-						 	 */
-#if PF_USE_WRITE
-	if (cardType != CT_UNKNOWN && !IS_SELECTED() ) disk_writep(0, 0);	/* Finalize write process if it is in progress */
-#endif
-
-	cardType = CT_UNKNOWN;
-
-	init_spi();
-
-	DESELECT();
-	for(uint8_t i =10; i>0; i--)	/* 80 dummy clock */
-	{ rx_spi(); }
-
-	for(notimeout=1000; notimeout && (send_cmd(GO_IDLE, 0x00) != IN_IDLE_STATE) ; notimeout--)
-	{
-		_delay_us(100);
-	}
-
-	if(notimeout)
-	{
-		if(send_cmd(CHECK_V, 0x01AA) == 0x01)	/* if CMD8 is valid */
-		{
-			/* card type is SDC2 or SDHC/SDXC */
-			for(uint8_t i=0; i<4; i++)	/* receive the 32 data bits of the response */
-			{	ocr[i] = rx_spi(); }
-
-			if(ocr[2] == 0x01 && ocr[3] == 0xAA)
-			{
-				/* wait for in_idle_state bit cleared */
-				for(notimeout=10000; notimeout && send_cmd(APP_INIT, HCS_SET ); notimeout--)
-				{
-				}
-
-				if(notimeout && send_cmd(READ_OCR, 0x00)== 0x00)	/* check if timeout reached */
-				{
-					/* check if CS flag is set to deduce correct card type */
-					for(uint8_t i=0; i<4 ; i++)
-						ocr[i] = rx_spi();
-
-					cardType = (ocr[0] & 0x40) ? CT_SDC2 | CT_BLOCK : CT_SDC2;
-				}
-			}
-		}
-		else	/* if CMD8 isnt valid or no response, Card imay be SDC v1 or MMC v3 */
-		{
-			/* wait exiting IDLE_STATE */
-			for(notimeout=10000; notimeout && send_cmd(APP_INIT, 0x00); notimeout--)
-				_delay_us(100);
-
-			if(notimeout)
-			{	
-				cardType = CT_SDC1;
-			}
-
-			else
-			{
-				for(notimeout=10000; notimeout && send_cmd(INIT, 0x00); notimeout--)
-					_delay_us(100);
-
-				cardType = (notimeout ? CT_MMC3 : CT_UNKNOWN);
-			}
-		}
-	}
-
-	/* set the block size if necessary */
-	if(!(cardType & CT_BLOCK) && cardType != CT_UNKNOWN)
-	{	
-		send_cmd(SET_BLOCKLEN, 0x0200);
-	}
-
-	DESELECT();
-
-	if(cardType != CT_UNKNOWN)
-		spi_set_rw_speed();/* increase spi clock frequency */
-
-	/* if card type has not been deduces */
-	return (cardType==CT_UNKNOWN) ? STA_NOINIT : 0;
-}
-
-
-
-/*-----------------------------------------------------------------------*/
-/* Read Partial Sector                                                   */
-/*-----------------------------------------------------------------------*/
-#if PF_USE_READ
-
-inline 
-static void skip_data(uint16_t bytes)
-{
-	while(bytes--)rx_spi();
-}
-
-DRESULT disk_readp (
-	BYTE* buff,		/* Pointer to the destination object */
-	DWORD sector,	/* Sector number (LBA) */
-	UINT offset,	/* Offset in the sector */
-	UINT count		/* Byte count (bit15:destination) */
-)
-{
-	DRESULT res = RES_ERROR;
-	uint16_t notimeout = 0, bc = 0;
-
-	if(cardType == CT_UNKNOWN)	/* check if card has been initialized */
-		return RES_NOTRDY;
-
-	if(!(cardType & CT_BLOCK)) sector<<=9;
-	
-	if(offset+count > 512)	/* check if the parameters are valid */
-		return RES_PARERR;
-
-	if(send_cmd(READ_SINGLE_BLOCK, sector) == 0x00)	/* initiate read */
-	{
-		/* wait for the data token to be received */
-		for(notimeout = 10000; notimeout && (rx_spi() != D_TOK1); notimeout--)
-		{;;}
-
-		if(notimeout)
-		{
-			bc = 512 + 2 - offset - count;	/* number of bytes to read -1 sector + CRC */
-
-			/* skip leading data */
-			skip_data(offset);
-
-			if(buff)
-			{
-				/* fill in the buffer */
-				do
-				{
-					*buff++=rx_spi();
-				}while(--count);
-			}
-			else
-			{
-				/* forward to the outgoing stream */
-				do
-				{
-					rx_spi();
-					FORWARD(0);
-				}while(--count);
-			}
-
-			skip_data(bc);/* skip trailing data and CRC */
-			res = RES_OK;
-		}
-	}
-
-	DESELECT();
-	rx_spi();
-
-	return res;
-}
-#endif
-
-/*-----------------------------------------------------------------------*/
-/* Write Partial Sector                                                  */
-/*-----------------------------------------------------------------------*/
-
-#if PF_USE_WRITE
-/* if only up to 512 bytes (one block) will be written
- * at a time
- */
-DRESULT disk_writep (
-	const BYTE *buff,	/* Pointer to the bytes to be written (NULL:Initiate/Finalize sector write) */
-	DWORD sc			/* Number of bytes to send, Sector number (LBA) or zero */
-)
-{
-	DRESULT res;
-	uint32_t bcnt;
-	static uint32_t wcnt;	/* Sector write counter */
-
-	//dbg("%s","entering disk_writep()\n");
-	//dbg("sc = %ld\n", sc);
-
-	res = RES_ERROR;
-
-	if (buff)	/* Send data bytes */
-	{
-		//dbg("%s","writing data packet\n");
-		bcnt = sc;
-		while (bcnt && wcnt)	/* Send data bytes to the card */
-		{		
-			tx_spi(*buff++);
-			wcnt--; bcnt--;
-		}
-		res = RES_OK;
-	}
-	else
-	{
-		if (sc)	/* Initiate sector write process */
-		{
-			//dbg("%s","initiating disk write\n");
-			if (!(cardType & CT_BLOCK)) sc <<=9;	/* Convert to byte address if needed */
-			if (send_cmd(WRITE_SINGLE_BLOCK, sc) == 0)	/* WRITE_SINGLE_BLOCK */
-			{
-				//dbg("%s","write command succeeded. Sending data token.\n");			
-				tx_spi(0xFF);
-				tx_spi(D_TOK1);	/* Data block header */
-				wcnt = 512;			/* Set byte counter */
-				res = RES_OK;
-			}
-		}
-		else	/* Finalize sector write process */
-		{
-			//dbg("%s","finalizing disk write\n");
-			bcnt = wcnt + 2;
-			while (bcnt--) tx_spi(0);	/* Fill left bytes and CRC with zeros */
-			if ((rx_spi() & DATA_RESP_MASK) == DATA_ACCEPTED)	/* Receive data resp and wait for end of write process in timeout of 500ms */
-			{	
-				//dbg("%s","data accepted. Waiting while card busy.\n");
-				for (bcnt = 10000; rx_spi() != 0xFF && bcnt; bcnt--)	/* Wait for ready */
-				{
-					//_delay_us(4);
-				}
-				if (bcnt) res = RES_OK;
-			}
-			DESELECT();
-			rx_spi();
-		}
-	}
-	//dbg("%s","exiting disk_writep()\n");
-	return res;
-}
-
-#endif
+/*-----------------------------------------------------------------------
+ * Low level disk I/O module for Petit FatFs (C)ChaN, 2014 
+ * 
+ * Designed for ATmega328P using SPI interface
+ * 
+ * Author   : Hugo Schaaf
+ * date     : 05/2019 
+ * 
+ * v2.2.3
+ *-----------------------------------------------------------------------*/
+
+#include "diskio.h"
+#include <avr/io.h>
+#include <util/delay.h>
+
+#if USE_MSPIM
+/* card bus on USART0 in master SPI mode (MSPIM)	*/
+/* XCK0 is SCK, TXD0 is MOSI and RXD0 is MISO,	*/
+/* CS is any free pin							*/
+#ifndef SPI_DDR
+	#define SPI_DDR		DDRD
+#endif
+#ifndef SPI_PORT
+	#define SPI_PORT 	PORTD
+#endif
+#ifndef SPI_CS
+	#define SPI_CS		PD5
+#endif
+#ifndef SPI_MOSI
+	#define SPI_MOSI	PD1
+#endif
+#ifndef SPI_MISO
+	#define SPI_MISO	PD0
+#endif
+#ifndef SPI_SCK
+	#define SPI_SCK		PD4
+#endif
+#else
+/* SPI pin definition 						*/
+/* here are specifications for atmega328p ! */
+#ifndef SPI_DDR
+	#define SPI_DDR		DDRB
+#endif
+#ifndef SPI_PORT
+	#define SPI_PORT 	PORTB
+#endif
+#ifndef SPI_CS
+	#define SPI_CS		PB2
+#endif
+#ifndef SPI_MOSI
+	#define SPI_MOSI	PB3
+#endif
+#ifndef SPI_MISO
+	#define SPI_MISO	PB4
+#endif
+#ifndef SPI_SCK
+	#define SPI_SCK		PB5
+#endif
+#endif
+
+/* Chip Select (CS) control */
+#ifndef SELECT()
+	#define SELECT()	SPI_PORT &= (uint8_t)(~_BV(SPI_CS))
+#endif
+#ifndef DESELECT()
+	#define DESELECT()	SPI_PORT |= (uint8_t)_BV(SPI_CS)
+#endif
+#ifndef IS_SELECTED()
+	#define IS_SELECTED() (SPI_PORT & _BV(SPI_CS))
+#endif
+
+/* SD/MMC SPI command set definiton */
+/* MSByte of a command frame -> 0 1 index[5:0]
+ * so b7:b6 01 stands for 0x40
+ */
+#define GO_IDLE 			(0x40 + 0)  /* CMD0 */
+#define INIT 				(0x40 + 1)  /* CMD1 */
+#define APP_INIT 			(0xC0 + 41) /* ACMD41, 1st bit set artificially to reconize acmd further */
+#define CHECK_V 			(0x40 + 8)  /* CMD8 */
+#define STOP_READ 			(0x40 + 12) /* CMD12 */
+#define SET_BLOCKLEN 		(0x40 + 16) /* CMD16 */
+#define READ_SINGLE_BLOCK 	(0x40 + 17) /* CMD17 */
+#define READ_MULTI_BLOCK 	(0x40 + 18) /* CMD18 */
+#define WRITE_SINGLE_BLOCK 	(0x40 + 24) /* CMD24 */
+#define WRITE_MULTI_BLOCK 	(0x40 + 25) /* CMD25 */
+#define ACMD_LEADING 		(0x40 + 55) /* CMD55 */
+#define READ_OCR 			(0x40 + 58) /* CMD58 */
+#define IS_ACMD(cmd)		(cmd & 0x80)/* test is this is an ACMD command */
+#define ACMD_MASK			0x7F		/* retrieve the following command of ACMD suite */	
+
+/* R1 response flags */
+#define IN_IDLE_STATE		0x01
+#define ERASE_RESET			0x02
+#define ILLEGAL_CMD			0x04
+#define CMD_CRC_ERR			0x08
+#define ERASE_SEQ_ERR		0x10
+#define ADDRESS_ERR			0x20
+#define PARAM_ERR			0x40
+#define IS_R1_RESP(i)		((i & 0x80)==0)
+
+/* Data Token */
+#define D_TOK1 				0xFE /* token for CMD17/18/24 */
+#define D_TOK2				0xFC /* token for CMD25 */
+#define STP_TRAN_TOK		0xFD /* stop transmission token for CDM25 */
+
+/* Flags definitions in command responses */
+#define HCS_SET				0x40000000UL
+#define CCS_SET				0x40000000UL
+
+/* Data responses flags */
+#define DATA_RESP_MASK		0x0F
+#define DATA_ACCEPTED		0x05
+#define DATA_CRC_ERR		0x0B
+#define DATA_WRITE_ERR		0x0D
+
+/* extreme values */
+#define DATA_MAX_SIZE		512	/* max number of bytes to read or write */
+
+/* valid CRC fields + 1 terminating bit
+ * if CMD0 or CMD8, CRC must be correct so add CRC
+ * CRC calculator : 
+ * http://www.ghsi.de/pages/subpages/Online%20CRC%20Calculation/
+ * with polynom : 10001001
+ * CRC 7bits + 1 (LSB) to from a byte so 
+ * i = (CRC<<1)+1
+ */
+#define GO_IDLE_CRC			0x95
+#define CHECK_V_CRC			0X87
+
+/* Card types identification */
+#define CT_UNKNOWN			0x00 /* byte adress for these cases */
+#define CT_SDC1				0x01 /*-                            */
+#define CT_SDC2				0x02 /*-                            */
+#define CT_MMC3				0x04 /*-                            */
+#define CT_BLOCK			0x08 /* block adress read/write in this case */
+
+/* forward data to the outgoing stream : the sample ring of the player,
+ * written around from ring_fwd (see playwaveutils.h). The receive loops
+ * keep the index in a local, FORWARD_OPEN() and FORWARD_CLOSE() load and
+ * store it.
+ */
+#include "playwaveutils.h"
+#define FORWARD_OPEN()		uint8_t fwd = ring_fwd
+#define FORWARD(d)			RING_FORWARD(fwd, d)
+#define FORWARD_CLOSE()		ring_fwd = fwd
+
+static uint8_t cardType;
+
+#if USE_MULTI_BLOCK_READ
+/* state of the pending READ_MULTI_BLOCK transaction */
+static uint8_t rdOpen;		/* a CMD18 transaction is in progress, card selected */
+static DWORD rdSector;		/* sector (LBA) currently received */
+static UINT rdOffset;		/* next byte to receive in rdSector, 512 when only the CRC is left */
+#endif
+
+#if PF_USE_ASYNC
+#if !USE_MULTI_BLOCK_READ
+#error PF_USE_ASYNC needs USE_MULTI_BLOCK_READ
+#endif
+#if USE_MSPIM
+#error PF_USE_ASYNC is driven by the SPI interrupt, not available with USE_MSPIM
+#endif
+#include <avr/interrupt.h>
+
+/* background read states, advanced by the SPI interrupt */
+#define AS_IDLE				0
+#define AS_CRC				1	/* skipping the CRC of the previous block */
+#define AS_TOKEN			2	/* waiting for the data token */
+#define AS_SKIP				3	/* skipping data up to the requested offset */
+#define AS_DATA				4	/* receiving data */
+#define AS_ERROR			5	/* data token timeout */
+
+static volatile uint8_t asState;
+static uint16_t asCnt;		/* bytes left in the current state, token timeout in AS_TOKEN */
+static uint16_t asSkip;		/* bytes to skip once the token is received */
+static uint16_t asCount;	/* bytes to receive */
+static BYTE* asBuff;		/* destination of the received bytes */
+#endif
+
+/*------------------------------------*/
+/* Prototypes for spi control, mode 0 */
+
+
+#if USE_MSPIM
+/* void init_spi(void)
+ *
+ * USART0 initialization in master SPI mode
+ * mode 0, MSB transmitted first, interrupts disabled
+ * SCK = F_CPU/(2*(UBRR0+1)) -> 250kHz at 16 MHz
+ * UBRR0 must be 0 when the transmitter is enabled, XCK0 output before.
+ */
+static inline
+void init_spi(void)
+{
+	SPI_DDR |= (uint8_t)(_BV(SPI_MOSI) | _BV(SPI_CS) | _BV(SPI_SCK));	/* RXD0 is overriden as an input */
+	SPI_PORT |= (uint8_t)_BV(SPI_MISO);	/* enable pullup resistor on MISO */
+
+	PRR &= (uint8_t)(~_BV(PRUSART0));	/* exit from power reduction mode to be able to enable USART0 */
+	UBRR0 = 0;
+	UCSR0C = (uint8_t)(_BV(UMSEL01) | _BV(UMSEL00));	/* MSPIM, UCPHA0 = UCPOL0 = 0, UDORD0 = 0 */
+	UCSR0B = (uint8_t)(_BV(RXEN0) | _BV(TXEN0));
+	UBRR0 = (uint16_t)(F_CPU/2/250000UL - 1);
+}
+
+/* void spi_set_rw_speed(void)
+ *
+ * Change the SCK frequency
+ * SCK -> 16MHz/2 = 8MHz, as with the SPI
+ */
+static inline
+void spi_set_rw_speed(void)
+{
+	UBRR0 = 0;
+}
+
+static inline
+uint8_t spi(uint8_t data)
+{
+	UDR0 = data;	/* a single byte in flight, the transmit buffer is free */
+	while( !(UCSR0A & (uint8_t)(_BV(RXC0))) )
+	{;;}
+	return (uint8_t)UDR0;
+}
+#else
+/* void init_spi(void)
+ *
+ * SPI initialization
+ * Enable SPI as master, interrupts disabled, MSB transmitted first
+ * mode 0 and 64 clock prescaling (supposing clk -> 16 MHz so spi clk running at 250kHz)
+ */
+static inline
+void init_spi(void)
+{
+	/* data direction settings first, to avoid automatic slave switching */
+	SPI_DDR |= (uint8_t)(_BV(SPI_MOSI) | _BV(SPI_CS) | _BV(SPI_SCK));	/* select data direction, 
+															   SPI_MISO is overriden as an input */
+	SPI_PORT |= (uint8_t)(_BV(SPI_MISO) | _BV(SPI_SCK) );	/* enable pullup resistor on MISO */
+
+	PRR &= (uint8_t)(~_BV(PRSPI));	/* exit from power reduction mode to be able to enable SPI */
+	SPSR &= (uint8_t)(~_BV(SPI2X));	/* disable spi double speed */
+	SPCR = (uint8_t)(_BV(SPE) | _BV(MSTR) | _BV(SPR1) | _BV(SPR0));
+}
+
+/* void spi_set_rw_speed(void)
+ *
+ * Change the SPI clock frequency
+ * assuming F_CPU is 16MHz, should not exceed
+ * 20-25MHz.
+ * SCK -> 16MHz/2 = 8MHz
+ */
+static inline
+void spi_set_rw_speed(void)
+{
+	SPCR &= (uint8_t)( ~(_BV(SPR1) | _BV(SPR0)) );	/* clear previous speed config */
+	SPSR |= (uint8_t)_BV(SPI2X);	/* set SCK freq = F_CPU/2 */
+}
+
+static inline
+uint8_t spi(uint8_t data)
+{	
+	SPDR = data;
+	while( !(SPSR & (uint8_t)(_BV(SPIF))) )
+	{;;}
+	return (uint8_t)SPDR;
+}
+#endif
+
+static inline
+uint8_t rx_spi(void)
+{
+	return spi(0xFF);
+}
+
+static inline
+void tx_spi(uint8_t data)
+{
+	spi(data);
+}
+
+static inline
+uint8_t waitNotBusy(uint16_t timeout)
+{
+	for(;timeout>0 && rx_spi()==0xFF; timeout--)
+	{ 	_delay_ms(1); }
+	return timeout>0;
+}
+
+
+/*-----------------------------------------*/
+/* Prototypes for SDC/MMC SPI mode control */
+
+/*-------------------------------------------*/
+/* uint8_t send_cmd(uint8_t cmd, uint32_t arg)
+ *
+ * send a command to the drive. 
+ * After sending a command, the drive is 
+ * still selected (eg CS low). No need to
+ * re-select the drive after having send a
+ * command !
+ */
+
+static uint8_t send_cmd(uint8_t cmd, uint32_t arg)
+{
+	uint8_t i = 0xFF, result = 0x00;	/* i : dummy CRC and Stop */
+
+	if(IS_ACMD(cmd))	/* if ACMD<n> command */
+	{
+		result = send_cmd(ACMD_LEADING, 0);
+		cmd &= ACMD_MASK;	/* clear the MSB artificially set to retrieve 
+					   	   the ACMD command index */
+		if(result>1)
+		{
+			return result;
+		}
+	}
+
+	/* give some extra clocks to the card and select it. STOP_READ is
+	 * sent within the data stream of READ_MULTI_BLOCK, the card stays
+	 * selected (CS toggling in a transfer is not allowed) */
+	if(cmd != STOP_READ)
+	{
+		DESELECT();
+		rx_spi();
+		SELECT();
+		rx_spi();
+	}
+
+	tx_spi(cmd);
+	tx_spi((uint8_t)(arg >> 24));
+	tx_spi((uint8_t)(arg >> 16));
+	tx_spi((uint8_t)(arg >> 8));
+	tx_spi((uint8_t)arg);
+
+	if(cmd == GO_IDLE)
+	{
+		i = GO_IDLE_CRC;
+	}
+	if(cmd == CHECK_V)
+	{
+		i = CHECK_V_CRC;
+	}
+
+	tx_spi(i);
+
+	if (cmd == STOP_READ)
+	{
+			result = rx_spi();	/* Receive stuff byte */
+	}
+
+	/* get the response to the command, 10 attempts. Maximum waiting time can be up to 8 dummy bytes */
+	i=10;
+	do
+	{
+		result = rx_spi();
+	}while( !IS_R1_RESP(result) && i--);
+
+	return result;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Initialize Disk Drive                                                 */
+/*-----------------------------------------------------------------------*/
+
+DSTATUS disk_initialize (void)
+{
+	uint8_t ocr[4]={0};
+	uint16_t notimeout=0;	/*	notimeout == 0	-> timeout reached
+						 	 *	notimeout > 0	-> timeout not reached
+						 	 */
+#if PF_USE_WRITE
+	if (cardType != CT_UNKNOWN && !IS_SELECTED() ) disk_writep(0, 0);	/* Finalize write process if it is in progress */
+#endif
+
+#if PF_USE_ASYNC
+	SPCR &= (uint8_t)(~_BV(SPIE));	/* abort a background read */
+	asState = AS_IDLE;
+#endif
+	cardType = CT_UNKNOWN;
+#if USE_MULTI_BLOCK_READ
+	rdOpen = 0;		/* any pending transaction is aborted by the card reset */
+#endif
+
+	init_spi();
+
+	DESELECT();
+	for(uint8_t i =10; i>0; i--)	/* 80 dummy clock */
+	{ rx_spi(); }
+
+	for(notimeout=1000; notimeout && (send_cmd(GO_IDLE, 0x00) != IN_IDLE_STATE) ; notimeout--)
+	{
+		_delay_us(100);
+	}
+
+	if(notimeout)
+	{
+		if(send_cmd(CHECK_V, 0x01AA) == 0x01)	/* if CMD8 is valid */
+		{
+			/* card type is SDC2 or SDHC/SDXC */
+			for(uint8_t i=0; i<4; i++)	/* receive the 32 data bits of the response */
+			{	ocr[i] = rx_spi(); }
+
+			if(ocr[2] == 0x01 && ocr[3] == 0xAA)
+			{
+				/* wait for in_idle_state bit cleared */
+				for(notimeout=10000; notimeout && send_cmd(APP_INIT, HCS_SET ); notimeout--)
+				{
+				}
+
+				if(notimeout && send_cmd(READ_OCR, 0x00)== 0x00)	/* check if timeout reached */
+				{
+					/* check if CS flag is set to deduce correct card type */
+					for(uint8_t i=0; i<4 ; i++)
+						ocr[i] = rx_spi();
+
+					cardType = (ocr[0] & 0x40) ? CT_SDC2 | CT_BLOCK : CT_SDC2;
+				}
+			}
+		}
+		else	/* if CMD8 isnt valid or no response, Card imay be SDC v1 or MMC v3 */
+		{
+			/* wait exiting IDLE_STATE */
+			for(notimeout=10000; notimeout && send_cmd(APP_INIT, 0x00); notimeout--)
+				_delay_us(100);
+
+			if(notimeout)
+			{	
+				cardType = CT_SDC1;
+			}
+
+			else
+			{
+				for(notimeout=10000; notimeout && send_cmd(INIT, 0x00); notimeout--)
+					_delay_us(100);
+
+				cardType = (notimeout ? CT_MMC3 : CT_UNKNOWN);
+			}
+		}
+	}
+
+	/* set the block size if necessary */
+	if(!(cardType & CT_BLOCK) && cardType != CT_UNKNOWN)
+	{	
+		send_cmd(SET_BLOCKLEN, 0x0200);
+	}
+
+	DESELECT();
+
+	if(cardType != CT_UNKNOWN)
+		spi_set_rw_speed();/* increase spi clock frequency */
+
+	/* if card type has not been deduces */
+	return (cardType==CT_UNKNOWN) ? STA_NOINIT : 0;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read Partial Sector                                                   */
+/*-----------------------------------------------------------------------*/
+#if PF_USE_READ
+
+#if USE_MSPIM
+/* double buffered receive loops
+ *
+ * the USART has a transmit buffer in front of the shift register and
+ * a two byte receive FIFO, two bytes are kept in flight : one shifting,
+ * the next one waiting in UDR0. When a byte is received, the waiting
+ * one is already on the bus, so the loop (read, store, count, next
+ * write) only has to keep up with 16 cycles per byte and SCK never
+ * pauses between bytes. RXC0 is cleared by the UDR0 read, the transmit
+ * buffer is checked before each write (UDRE0 is set as soon as the
+ * waiting byte moves to the shift register).
+ */
+#define SPI_WAIT()	while( !(UCSR0A & (uint8_t)(_BV(RXC0))) ) {;;}
+#define SPI_TX()	do { while( !(UCSR0A & (uint8_t)(_BV(UDRE0))) ) {;;} UDR0 = 0xFF; } while(0)
+
+static void skip_data(uint16_t bytes)
+{
+	uint16_t tx = bytes;
+
+	if(!bytes) return;
+
+	SPI_TX(); tx--;
+	if(tx) { SPI_TX(); tx--; }
+	while(bytes--)
+	{
+		SPI_WAIT();
+		(void)UDR0;
+		if(tx) { SPI_TX(); tx--; }
+	}
+}
+
+static void rx_block(BYTE* buff, UINT count)
+{
+	UINT tx = count;
+
+	if(!count) return;
+
+	SPI_TX(); tx--;
+	if(tx) { SPI_TX(); tx--; }
+	while(count--)
+	{
+		SPI_WAIT();
+		*buff++ = UDR0;
+		if(tx) { SPI_TX(); tx--; }	/* refill the transmit buffer */
+	}
+}
+
+/* same as rx_block(), the bytes are forwarded to the outgoing stream */
+static void rx_forward(UINT count)
+{
+	UINT tx = count;
+	uint8_t d;
+	FORWARD_OPEN();
+
+	if(!count) return;
+
+	SPI_TX(); tx--;
+	if(tx) { SPI_TX(); tx--; }
+	while(count--)
+	{
+		SPI_WAIT();
+		d = UDR0;
+		if(tx) { SPI_TX(); tx--; }
+		FORWARD(d);
+	}
+	FORWARD_CLOSE();
+}
+#else
+/* pipelined receive loops
+ *
+ * the next transfer is started as soon as the byte received is read
+ * from SPDR, the store and the loop run while the bus shifts it. At
+ * SCK = F_CPU/2 a byte takes 16 cycles on the bus, the loop (store,
+ * count, branch) is hidden in it, then the SPIF polling loop (4 cycles
+ * a turn) and the SPDR read add 4 to 7 cycles : 20 to 24 cycles per
+ * byte, see make spicycles for the built code. As the loop is hidden
+ * in the transfer, unrolling it gains nothing.
+ * SPIF is cleared by the SPSR read and the SPDR access that follows.
+ */
+#define SPI_WAIT()	while( !(SPSR & (uint8_t)(_BV(SPIF))) ) {;;}
+
+static void skip_data(uint16_t bytes)
+{
+	if(!bytes) return;
+
+	SPDR = 0xFF;
+	while(--bytes)
+	{
+		SPI_WAIT();
+		SPDR = 0xFF;
+	}
+	SPI_WAIT();
+	(void)SPDR;
+}
+
+static void rx_block(BYTE* buff, UINT count)
+{
+	uint8_t d;
+
+	if(!count) return;
+
+	SPDR = 0xFF;
+	while(--count)
+	{
+		SPI_WAIT();
+		d = SPDR;
+		SPDR = 0xFF;	/* next byte on the bus while this one is stored */
+		*buff++ = d;
+	}
+	SPI_WAIT();
+	*buff = SPDR;
+}
+
+/* same as rx_block(), the bytes are forwarded to the outgoing stream */
+static void rx_forward(UINT count)
+{
+	uint8_t d;
+	FORWARD_OPEN();
+
+	if(!count) return;
+
+	SPDR = 0xFF;
+	while(--count)
+	{
+		SPI_WAIT();
+		d = SPDR;
+		SPDR = 0xFF;
+		FORWARD(d);
+	}
+	SPI_WAIT();
+	d = SPDR;
+	FORWARD(d);
+	FORWARD_CLOSE();
+}
+#endif
+
+/* uint8_t wait_token(void)
+ *
+ * wait for the data token announcing a block.
+ * Return 0 if the token has not been received in time.
+ */
+static uint8_t wait_token(void)
+{
+	uint16_t notimeout;
+
+	for(notimeout = 10000; notimeout && (rx_spi() != D_TOK1); notimeout--)
+	{;;}
+
+	return notimeout>0;
+}
+
+#if USE_MULTI_BLOCK_READ
+
+#if PF_USE_ASYNC
+/* uint8_t async_wait(void)
+ *
+ * wait for the end of the background read.
+ * Return 1 if it has failed, the error is
+ * reported only once.
+ */
+static uint8_t async_wait(void)
+{
+	while(asState != AS_IDLE && asState != AS_ERROR)
+	{;;}
+
+	if(asState == AS_IDLE) return 0;
+	asState = AS_IDLE;
+	return 1;
+}
+#endif
+
+/*-------------------------------------------*/
+/* DRESULT disk_stop_read(void)
+ *
+ * terminate the pending READ_MULTI_BLOCK
+ * transaction if any and release the card.
+ * Called on every discontinuity of the read
+ * stream, or by the file system to release
+ * the bus when a file is left.
+ */
+DRESULT disk_stop_read(void)
+{
+	DRESULT res = RES_OK;
+	uint16_t notimeout;
+
+#if PF_USE_ASYNC
+	async_wait();	/* the bus must be free, the transaction is stopped anyway */
+#endif
+	if(rdOpen)
+	{
+		rdOpen = 0;
+		if(send_cmd(STOP_READ, 0) != 0x00) res = RES_ERROR;
+
+		/* the card may hold the bus busy (0x00) after CMD12 */
+		for(notimeout = 10000; notimeout && (rx_spi() != 0xFF); notimeout--)
+		{;;}
+		if(!notimeout) res = RES_ERROR;
+
+		DESELECT();
+		rx_spi();
+	}
+
+	return res;
+}
+
+DRESULT disk_readp (
+	BYTE* buff,		/* Pointer to the destination object */
+	DWORD sector,	/* Sector number (LBA) */
+	UINT offset,	/* Offset in the sector */
+	UINT count		/* Byte count (bit15:destination) */
+)
+{
+	if(cardType == CT_UNKNOWN)	/* check if card has been initialized */
+		return RES_NOTRDY;
+
+	if(offset+count > 512)	/* check if the parameters are valid */
+		return RES_PARERR;
+
+#if PF_USE_ASYNC
+	if(async_wait())	/* the stream is broken by a failed background read */
+	{
+		disk_stop_read();
+		return RES_ERROR;
+	}
+#endif
+
+	if(rdOpen)
+	{
+		if(sector == rdSector+1 && rdOffset == 512)	/* the following block is requested */
+		{
+			skip_data(2);	/* CRC of the previous block */
+			if(!wait_token())
+			{
+				disk_stop_read();
+				return RES_ERROR;
+			}
+			rdSector = sector;
+			rdOffset = 0;
+		}
+		else if(sector != rdSector || offset < rdOffset)	/* the stream can't go backward */
+		{
+			disk_stop_read();
+		}
+	}
+
+	if(!rdOpen)	/* initiate a new transaction */
+	{
+		if(send_cmd(READ_MULTI_BLOCK, (cardType & CT_BLOCK) ? sector : sector<<9) != 0x00 || !wait_token())
+		{
+			DESELECT();
+			rx_spi();
+			return RES_ERROR;
+		}
+		rdOpen = 1;
+		rdSector = sector;
+		rdOffset = 0;
+	}
+
+	/* skip data up to the requested offset */
+	skip_data((uint16_t)(offset - rdOffset));
+	rdOffset = offset + count;
+
+	if(buff) rx_block(buff, count);	/* fill in the buffer */
+	else rx_forward(count);			/* forward to the outgoing stream */
+
+	/* the card stays selected, the rest of the block is read on the next call */
+	return RES_OK;
+}
+
+#if PF_USE_ASYNC
+
+/*-------------------------------------------*/
+/* DRESULT disk_readp_start(BYTE* buff, DWORD sector, UINT offset, UINT count)
+ *
+ * same as disk_readp() but the data bytes
+ * are received in the background : the read
+ * is a state machine advanced by the SPI
+ * Transfer Complete interrupt, one byte per
+ * interrupt. Only a new transaction command
+ * is sent before returning. The buffer must
+ * not be used before disk_readp_busy() returns 0,
+ * a failure is reported by the next read.
+ */
+DRESULT disk_readp_start (
+	BYTE* buff,		/* Pointer to the destination object */
+	DWORD sector,	/* Sector number (LBA) */
+	UINT offset,	/* Offset in the sector */
+	UINT count		/* Byte count */
+)
+{
+	uint8_t state;
+
+	if(cardType == CT_UNKNOWN)	/* check if card has been initialized */
+		return RES_NOTRDY;
+
+	if(!buff || !count || offset+count > 512)	/* check if the parameters are valid */
+		return RES_PARERR;
+
+	if(async_wait())
+	{
+		disk_stop_read();
+		return RES_ERROR;
+	}
+
+	asSkip = 0;
+	if(rdOpen && sector == rdSector+1 && rdOffset == 512)	/* the following block is requested */
+	{
+		state = AS_CRC;
+		asCnt = 2;
+		asSkip = offset;
+		rdSector = sector;
+	}
+	else
+	{
+		if(rdOpen && (sector != rdSector || offset < rdOffset))	/* the stream can't go backward */
+			disk_stop_read();
+
+		if(!rdOpen)	/* initiate a new transaction */
+		{
+			if(send_cmd(READ_MULTI_BLOCK, (cardType & CT_BLOCK) ? sector : sector<<9) != 0x00)
+			{
+				DESELECT();
+				rx_spi();
+				return RES_ERROR;
+			}
+			rdOpen = 1;
+			rdSector = sector;
+			state = AS_TOKEN;
+			asCnt = 10000;
+			asSkip = offset;
+		}
+		else if(offset > rdOffset)	/* skip data up to the requested offset */
+		{
+			state = AS_SKIP;
+			asCnt = offset - rdOffset;
+		}
+		else
+		{
+			state = AS_DATA;
+			asCnt = count;
+		}
+	}
+
+	asCount = count;
+	asBuff = buff;
+	rdOffset = offset + count;
+
+	asState = state;
+	SPCR |= (uint8_t)_BV(SPIE);
+	SPDR = 0xFF;	/* clock the first byte, the interrupt does the rest */
+
+	return RES_OK;
+}
+
+/* BYTE disk_readp_busy(void)
+ *
+ * return 1 while a background read is in progress
+ */
+BYTE disk_readp_busy (void)
+{
+	return asState != AS_IDLE && asState != AS_ERROR;
+}
+
+/* SPI Transfer Complete interrupt
+ *
+ * a byte has been received, store or drop it
+ * depending on the state of the read and clock
+ * the next one until the end of the transfer.
+ */
+ISR(SPI_STC_vect)
+{
+	uint8_t d = SPDR;
+
+	switch(asState)
+	{
+		case AS_CRC:
+			if(--asCnt) break;
+			asState = AS_TOKEN;
+			asCnt = 10000;
+			break;
+
+		case AS_TOKEN:
+			if(d == D_TOK1)
+			{
+				asState = asSkip ? AS_SKIP : AS_DATA;
+				asCnt = asSkip ? asSkip : asCount;
+			}
+			else if(!--asCnt)
+			{
+				asState = AS_ERROR;
+			}
+			break;
+
+		case AS_SKIP:
+			if(--asCnt) break;
+			asState = AS_DATA;
+			asCnt = asCount;
+			break;
+
+		case AS_DATA:
+			*asBuff++ = d;
+			if(--asCnt) break;
+			asState = AS_IDLE;
+			break;
+	}
+
+	if(asState == AS_IDLE || asState == AS_ERROR)
+		SPCR &= (uint8_t)(~_BV(SPIE));	/* end of the transfer */
+	else
+		SPDR = 0xFF;
+}
+#endif /* PF_USE_ASYNC */
+
+#else
+
+DRESULT disk_readp (
+	BYTE* buff,		/* Pointer to the destination object */
+	DWORD sector,	/* Sector number (LBA) */
+	UINT offset,	/* Offset in the sector */
+	UINT count		/* Byte count (bit15:destination) */
+)
+{
+	DRESULT res = RES_ERROR;
+	uint16_t bc = 0;
+
+	if(cardType == CT_UNKNOWN)	/* check if card has been initialized */
+		return RES_NOTRDY;
+
+	if(!(cardType & CT_BLOCK)) sector<<=9;
+	
+	if(offset+count > 512)	/* check if the parameters are valid */
+		return RES_PARERR;
+
+	if(send_cmd(READ_SINGLE_BLOCK, sector) == 0x00)	/* initiate read */
+	{
+		/* wait for the data token to be received */
+		if(wait_token())
+		{
+			bc = 512 + 2 - offset - count;	/* number of bytes to read -1 sector + CRC */
+
+			/* skip leading data */
+			skip_data(offset);
+
+			if(buff) rx_block(buff, count);	/* fill in the buffer */
+			else rx_forward(count);			/* forward to the outgoing stream */
+
+			skip_data(bc);/* skip trailing data and CRC */
+			res = RES_OK;
+		}
+	}
+
+	DESELECT();
+	rx_spi();
+
+	return res;
+}
+#endif /* USE_MULTI_BLOCK_READ */
+#endif
+
+/*-----------------------------------------------------------------------*/
+/* Write Partial Sector                                                  */
+/*-----------------------------------------------------------------------*/
+
+#if PF_USE_WRITE
+/* if only up to 512 bytes (one block) will be written
+ * at a time
+ */
+DRESULT disk_writep (
+	const BYTE *buff,	/* Pointer to the bytes to be written (NULL:Initiate/Finalize sector write) */
+	DWORD sc			/* Number of bytes to send, Sector number (LBA) or zero */
+)
+{
+	DRESULT res;
+	uint32_t bcnt;
+	static uint32_t wcnt;	/* Sector write counter */
+
+	//dbg("%s","entering disk_writep()\n");
+	//dbg("sc = %ld\n", sc);
+
+	res = RES_ERROR;
+
+	if (buff)	/* Send data bytes */
+	{
+		//dbg("%s","writing data packet\n");
+		bcnt = sc;
+		while (bcnt && wcnt)	/* Send data bytes to the card */
+		{		
+			tx_spi(*buff++);
+			wcnt--; bcnt--;
+		}
+		res = RES_OK;
+	}
+	else
+	{
+		if (sc)	/* Initiate sector write process */
+		{
+			//dbg("%s","initiating disk write\n");
+#if USE_MULTI_BLOCK_READ
+			disk_stop_read();	/* the card must leave the read transaction first */
+#endif
+			if (!(cardType & CT_BLOCK)) sc <<=9;	/* Convert to byte address if needed */
+			if (send_cmd(WRITE_SINGLE_BLOCK, sc) == 0)	/* WRITE_SINGLE_BLOCK */
+			{
+				//dbg("%s","write command succeeded. Sending data token.\n");			
+				tx_spi(0xFF);
+				tx_spi(D_TOK1);	/* Data block header */
+				wcnt = 512;			/* Set byte counter */
+				res = RES_OK;
+			}
+		}
+		else	/* Finalize sector write process */
+		{
+			//dbg("%s","finalizing disk write\n");
+			bcnt = wcnt + 2;
+			while (bcnt--) tx_spi(0);	/* Fill left bytes and CRC with zeros */
+			if ((rx_spi() & DATA_RESP_MASK) == DATA_ACCEPTED)	/* Receive data resp and wait for end of write process in timeout of 500ms */
+			{	
+				//dbg("%s","data accepted. Waiting while card busy.\n");
+				for (bcnt = 10000; rx_spi() != 0xFF && bcnt; bcnt--)	/* Wait for ready */
+				{
+					//_delay_us(4);
+				}
+				if (bcnt) res = RES_OK;
+			}
+			DESELECT();
+			rx_spi();
+		}
+	}
+	//dbg("%s","exiting disk_writep()\n");
+	return res;
+}
+
+#endif
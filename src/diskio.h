@@ -1,50 +1,76 @@
-/*-----------------------------------------------------------------------
-/  PFF - Low level disk interface modlue include file    (C)ChaN, 2014
-/-----------------------------------------------------------------------*/
-
-#ifndef _DISKIO_DEFINED
-#define _DISKIO_DEFINED
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-#include "pff.h"
-
-/* I don't know if it changes really something. I have written 2 versions
- * of DRESULT disk_writep(BYTE*, DWORD).
- * By default let USE_MULTI_BLOCK_WRITE disabled.
- * 0 -> disable
- * 1 -> enable
- */
-#define USE_MULTI_BLOCK_WRITE	0
-
-
-/* Status of Disk Functions */
-typedef BYTE	DSTATUS;
-
-
-/* Results of Disk Functions */
-typedef enum {
-	RES_OK = 0,		/* 0: Function succeeded */
-	RES_ERROR,		/* 1: Disk error */
-	RES_NOTRDY,		/* 2: Not ready */
-	RES_PARERR		/* 3: Invalid parameter */
-} DRESULT;
-
-
-/*---------------------------------------*/
-/* Prototypes for disk control functions */
-
-DSTATUS disk_initialize (void);
-DRESULT disk_readp (BYTE* buff, DWORD sector, UINT offser, UINT count);
-DRESULT disk_writep (const BYTE* buff, DWORD sc);
-
-#define STA_NOINIT		0x01	/* Drive not initialized */
-#define STA_NODISK		0x02	/* No medium in the drive */
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif	/* _DISKIO_DEFINED */
+/*-----------------------------------------------------------------------
+/  PFF - Low level disk interface modlue include file    (C)ChaN, 2014
+/-----------------------------------------------------------------------*/
+
+#ifndef _DISKIO_DEFINED
+#define _DISKIO_DEFINED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pff.h"
+
+/* I don't know if it changes really something. I have written 2 versions
+ * of DRESULT disk_writep(BYTE*, DWORD).
+ * By default let USE_MULTI_BLOCK_WRITE disabled.
+ * 0 -> disable
+ * 1 -> enable
+ */
+#define USE_MULTI_BLOCK_WRITE	0
+
+/* Streaming reads. When enabled, disk_readp() opens a READ_MULTI_BLOCK
+ * (CMD18) transaction and keeps the card selected between calls, so
+ * consecutive reads of the same or the following sector cost no command.
+ * The transaction is stopped (CMD12) on a discontinuity or by disk_stop_read().
+ * 0 -> disable, every read is a READ_SINGLE_BLOCK (CMD17)
+ * 1 -> enable
+ */
+#define USE_MULTI_BLOCK_READ	1
+
+/* Card transport, see avr_mmcp.c. When enabled, the card is on USART0 in
+ * master SPI mode (XCK0/TXD0/RXD0) instead of the SPI, and the serial
+ * messages go out on a software transmitter (see usart328p.h).
+ * 0 -> SPI
+ * 1 -> USART0 MSPIM (not with PF_USE_ASYNC)
+ */
+#ifndef USE_MSPIM
+#define USE_MSPIM	0
+#endif
+
+
+/* Status of Disk Functions */
+typedef BYTE	DSTATUS;
+
+
+/* Results of Disk Functions */
+typedef enum {
+	RES_OK = 0,		/* 0: Function succeeded */
+	RES_ERROR,		/* 1: Disk error */
+	RES_NOTRDY,		/* 2: Not ready */
+	RES_PARERR		/* 3: Invalid parameter */
+} DRESULT;
+
+
+/*---------------------------------------*/
+/* Prototypes for disk control functions */
+
+DSTATUS disk_initialize (void);
+DRESULT disk_readp (BYTE* buff, DWORD sector, UINT offser, UINT count);
+DRESULT disk_writep (const BYTE* buff, DWORD sc);
+#if USE_MULTI_BLOCK_READ
+DRESULT disk_stop_read (void);
+#endif
+#if PF_USE_ASYNC
+DRESULT disk_readp_start (BYTE* buff, DWORD sector, UINT offset, UINT count);
+BYTE disk_readp_busy (void);
+#endif
+
+#define STA_NOINIT		0x01	/* Drive not initialized */
+#define STA_NODISK		0x02	/* No medium in the drive */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _DISKIO_DEFINED */
@@ -10,17 +10,26 @@
  */
 #include <avr/io.h>
 #include <util/delay.h>
-#include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include "pff.h"
 #include "playwaveutils.h"
 #include "usart328p.h"
 
+/* 1 : the files are played back to back, the timers keep running and
+ * the next file is streamed while the previous one drains. The USART
+ * (9600 baud, about 1ms per character) only reports the errors then.
+ * 0 : every file is played on its own, with its name and status.
+ */
+#define PLAY_GAPLESS	1
+
 FATFS fs;
 DIR dir;
 FILINFO fno;
 
 void IO_init(void);
+void play(const char* name, uint32_t n);
+void print_health(void);
 
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 /* main thread
@@ -28,12 +37,26 @@ void IO_init(void);
 int main(void)
 {
 	FRESULT res;
-	char path[23];
+	uint16_t i, n;
 
 	IO_init();
 
 	res = pf_mount(&fs);
 	if(res != FR_OK) usart_puts("Cannot mount memory card.\n");
+	else if((n = index_open()) != 0)
+	{
+		/* play the playlist index, the tracks are opened
+		 * by their location, without directory lookup */
+		for(i = 0; i < n; i++)
+		{
+			uint32_t r = index_load(i, fno.fname);
+
+			play(fno.fname, r);
+		}
+		playback_end();
+		usart_puts("Playlist entirely played.\n");
+		print_health();
+	}
 	else
 	{
 		res = pf_opendir(&dir, "WAV");
@@ -46,23 +69,13 @@ int main(void)
 				res = pf_readdir(&dir, &fno);
 				if( res != FR_OK || fno.fname[0] == '\0') break;
 
-				usart_puts("\nOpen : ");
-				usart_puts(fno.fname);
-				
-				sprintf(path, "%s/%s", "WAV", fno.fname);
-				res = pf_open(path);
-				if( load_header() < 1024)
-				{
-					usart_puts("\ncan't play file.\n");
-				}
-				else
-				{
-					usart_puts("\nstart playing...\n");
-					if(playback()) usart_puts("error whilhe playing.\n");
-					else usart_puts("file successfully played.\n");
-				}
+				/* opened from the directory item, no path lookup */
+				res = pf_openentry(&fno);
+				play(fno.fname, res == FR_OK ? load_header() : 0);
 			}
+			playback_end();
 			usart_puts("Directory entirely played.\n");
+			print_health();
 		}
 	}
 
@@ -76,6 +89,55 @@ int main(void)
  * utility stuff
  */
 
+/* play the file opened by load_header() or index_load(),
+ * n : their result
+ */
+void play(const char* name, uint32_t n)
+{
+#if PLAY_GAPLESS
+	if(n < 1024 || playback_stream())
+	{
+		usart_puts("\ncan't play ");
+		usart_puts(name);
+		usart_puts(".\n");
+	}
+#else
+	usart_puts("\nOpen : ");
+	usart_puts(name);
+	if(n < 1024)
+	{
+		usart_puts("\ncan't play file.\n");
+	}
+	else
+	{
+		usart_puts("\nstart playing...\n");
+		if(playback()) usart_puts("error whilhe playing.\n");
+		else usart_puts("file successfully played.\n");
+		print_health();
+	}
+#endif
+}
+
+/* report the playback health counters since the last report */
+void print_health(void)
+{
+#if PLAY_HEALTH
+	PLAYHEALTH h;
+	char str[6];
+
+	playback_health(&h, 1);
+	usart_puts("underruns : ");
+	usart_puts(utoa(h.underruns, str, 10));
+	usart_puts(", refill max : ");
+	usart_puts(utoa(h.refill_max, str, 10));
+	usart_puts(" ticks, stalls : ");
+	usart_puts(utoa(h.stalls, str, 10));
+	usart_puts(", disk errors : ");
+	usart_puts(utoa(h.disk_errors, str, 10));
+	usart_puts("\n");
+#endif
+}
+
 void IO_init(void)
 {
 	usart_init(9600);	/* init the usart interface */
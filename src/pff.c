@@ -62,6 +62,10 @@
 #define _FS_32ONLY 0
 #endif
 
+#if PF_FAT_WINDOW && ((PF_FAT_WINDOW & (PF_FAT_WINDOW - 1)) || PF_FAT_WINDOW < 4 || PF_FAT_WINDOW > 512)
+#error Wrong PF_FAT_WINDOW setting, a power of 2 from 4 to 512.
+#endif
+
 #define ABORT(err)	{fs->flag = 0; return err;}
 
 
@@ -421,6 +425,34 @@ static int mem_cmp (const void* dst, const void* src, int cnt) {
 
 
 
+/*-----------------------------------------------------------------------*/
+/* FAT access - Load the window of a FAT entry                           */
+/*-----------------------------------------------------------------------*/
+#if PF_FAT_WINDOW
+
+static const BYTE* fat_window (	/* Pointer to the FAT entry in the window, 0:IO error */
+	DWORD sect,		/* FAT sector of the entry */
+	UINT ofs		/* Offset of the entry in the sector */
+)
+{
+	UINT wofs = ofs & ~(UINT)(PF_FAT_WINDOW - 1);	/* Windows tile the sector, a forward walk reads them in sequence */
+	FATFS *fs = FatFs;
+
+
+	if (sect != fs->fw_sect || wofs != fs->fw_ofs) {	/* Out of the window? */
+		fs->fw_sect = 0;
+		if (disk_readp(fs->fw_buf, sect, wofs, PF_FAT_WINDOW)) return 0;
+		fs->fw_sect = sect;
+		fs->fw_ofs = wofs;
+	}
+
+	return fs->fw_buf + (ofs - fs->fw_ofs);
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* FAT access - Read value of a FAT entry                                */
 /*-----------------------------------------------------------------------*/
@@ -429,7 +461,12 @@ static CLUST get_fat (	/* 1:IO error, Else:Cluster status */
 	CLUST clst	/* Cluster# to get the link information */
 )
 {
+#if PF_FAT_WINDOW
+	const BYTE *p;
+#endif
+#if !PF_FAT_WINDOW || PF_FS_FAT12
 	BYTE buf[4];
+#endif
 	FATFS *fs = FatFs;
 #if PF_FS_FAT12
 	UINT wc, bc, ofs;
@@ -454,13 +491,25 @@ static CLUST get_fat (	/* 1:IO error, Else:Cluster status */
 #endif
 #if PF_FS_FAT16
 	case FS_FAT16 :
+#if PF_FAT_WINDOW
+		p = fat_window(fs->fatbase + clst / 256, ((UINT)clst % 256) * 2);
+		if (!p) break;
+		return ld_word(p);
+#else
 		if (disk_readp(buf, fs->fatbase + clst / 256, ((UINT)clst % 256) * 2, 2)) break;
 		return ld_word(buf);
 #endif
+#endif
 #if PF_FS_FAT32
 	case FS_FAT32 :
+#if PF_FAT_WINDOW
+		p = fat_window(fs->fatbase + clst / 128, ((UINT)clst % 128) * 4);
+		if (!p) break;
+		return ld_dword(p) & 0x0FFFFFFF;
+#else
 		if (disk_readp(buf, fs->fatbase + clst / 128, ((UINT)clst % 128) * 4, 4)) break;
 		return ld_dword(buf) & 0x0FFFFFFF;
+#endif
 #endif
 	}
 
@@ -470,6 +519,119 @@ static CLUST get_fat (	/* 1:IO error, Else:Cluster status */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Cluster run cache - Load the runs of a cluster chain                  */
+/*-----------------------------------------------------------------------*/
+#if PF_CLUST_CACHE
+
+static FRESULT cache_fill (
+	CLUST clst		/* First cluster of the runs to be loaded */
+)
+{
+	CLUST nxt, *run;
+	BYTE n;
+	UINT w;
+	FATFS *fs = FatFs;
+
+
+	n = 0;
+	run = fs->cc_run[0];
+	run[0] = clst; run[1] = 1;
+	for (w = PF_CLUST_WALK; w; w--) {		/* Follow the chain until the cache is full, PF_CLUST_WALK links at most */
+		nxt = get_fat(clst);
+		if (nxt <= 1) {
+			fs->cc_n = 0;
+			return FR_DISK_ERR;
+		}
+		if (nxt >= fs->n_fatent) break;		/* End of chain */
+		if (nxt == clst + 1) {				/* Contiguous, extend the run */
+			run[1]++;
+		} else {							/* Fragmented, start a new run */
+			if (++n == PF_CLUST_CACHE) break;
+			run = fs->cc_run[n];
+			run[0] = nxt; run[1] = 1;
+		}
+		clst = nxt;
+	}
+	fs->cc_n = (n == PF_CLUST_CACHE) ? n : n + 1;
+	fs->cc_i = 0;
+	fs->cc_left = fs->cc_run[0][1] - 1;
+
+	return FR_OK;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Cluster run cache - Locate a cluster in the cache                     */
+/*-----------------------------------------------------------------------*/
+
+static BYTE cache_seek (	/* 1:Found, 0:Not cached */
+	CLUST clst		/* Cluster# to be located */
+)
+{
+	BYTE i;
+	FATFS *fs = FatFs;
+
+
+	for (i = 0; i < fs->cc_n; i++) {
+		if (clst >= fs->cc_run[i][0] && clst - fs->cc_run[i][0] < fs->cc_run[i][1]) {
+			fs->cc_i = i;
+			fs->cc_left = fs->cc_run[i][1] - 1 - (clst - fs->cc_run[i][0]);
+			return 1;
+		}
+	}
+	fs->cc_i = fs->cc_n;	/* Force a reload on the next cluster */
+	fs->cc_left = 0;
+
+	return 0;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Cluster run cache - Get the cluster following the current one        */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT check_contig (void);
+
+static CLUST next_clust (	/* 1:IO error, Else:Cluster status */
+	CLUST clst		/* Current cluster# of the file */
+)
+{
+	CLUST nxt, len;
+	FATFS *fs = FatFs;
+
+
+	if (fs->cc_left) {						/* In the current run */
+		fs->cc_left--;
+		return clst + 1;
+	}
+	if (fs->cc_i + 1 < fs->cc_n) {			/* Top of the next cached run */
+		fs->cc_i++;
+		fs->cc_left = fs->cc_run[fs->cc_i][1] - 1;
+		return fs->cc_run[fs->cc_i][0];
+	}
+
+	nxt = get_fat(clst);					/* Cache exhausted, load the following runs */
+	if (nxt > 1 && nxt < fs->n_fatent) {
+		len = (fs->cc_n == 1 && fs->cc_i == 0 && fs->cc_run[0][0] == fs->org_clust
+			&& clst == fs->cc_run[0][0] + fs->cc_run[0][1] - 1 && nxt == clst + 1) ? fs->cc_run[0][1] : 0;
+		if (cache_fill(nxt) != FR_OK) return 1;
+		if (len) {							/* The first run of the file goes on, extend it */
+			fs->cc_run[0][0] = fs->org_clust;
+			fs->cc_run[0][1] += len;
+			if (check_contig() != FR_OK) return 1;	/* Contiguous as a whole? */
+		}
+	}
+
+	return nxt;
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Get sector# from cluster# / Get cluster field from directory entry    */
 /*-----------------------------------------------------------------------*/
@@ -505,6 +667,45 @@ static CLUST get_clust (
 }
 
 
+/*-----------------------------------------------------------------------*/
+/* Check if the open file is stored in contiguous clusters               */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT check_contig (void)
+{
+	DWORD nsect;
+	FATFS *fs = FatFs;
+#if !PF_CLUST_CACHE
+	CLUST clst, nxt;
+	DWORD n;
+	UINT w;
+#endif
+
+
+	if (!fs->org_clust) return FR_OK;			/* Empty file */
+	nsect = (fs->fsize + 511) / 512;			/* Number of sectors of the file */
+#if PF_CLUST_CACHE
+	if ((DWORD)fs->cc_run[0][1] * fs->csize < nsect) return FR_OK;	/* The first run is shorter than the file */
+#else
+	clst = fs->org_clust;
+	for (n = fs->csize, w = PF_CLUST_WALK; n < nsect; n += fs->csize) {	/* Follow the chain while it is contiguous */
+		if (!w--) return FR_OK;					/* Too long to be checked at open, FAT lookups */
+		nxt = get_fat(clst);
+		if (nxt <= 1) return FR_DISK_ERR;
+		if (nxt != clst + 1) return FR_OK;		/* Fragmented */
+		clst = nxt;
+	}
+#endif
+	fs->org_sect = clust2sect(fs->org_clust);
+	if (!fs->org_sect) return FR_DISK_ERR;
+	fs->flag |= FA_CONTIG;
+
+	return FR_OK;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Rewind directory index                           */
 /*-----------------------------------------------------------------------*/
@@ -724,6 +925,7 @@ static void get_fileinfo (		/* No return code */
 		}
 		fno->fattrib = dir[DIR_Attr];				/* Attribute */
 		fno->fsize = ld_dword(dir+DIR_FileSize);	/* Size */
+		fno->fclust = get_clust(dir);				/* Start cluster */
 		fno->fdate = ld_word(dir+DIR_WrtDate);		/* Date */
 		fno->ftime = ld_word(dir+DIR_WrtTime);		/* Time */
 	}
@@ -884,6 +1086,9 @@ FRESULT pf_mount (
 	fs->database = fs->fatbase + fsize + fs->n_rootdir / 16;	/* Data start sector (lba) */
 
 	fs->flag = 0;
+#if PF_FAT_WINDOW
+	fs->fw_sect = 0;					/* Empty FAT window */
+#endif
 	FatFs = fs;
 
 	return FR_OK;
@@ -892,6 +1097,37 @@ FRESULT pf_mount (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Open a file from its start cluster and size                           */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT open_file (
+	CLUST sclust,	/* File start cluster (0:Empty file) */
+	DWORD size		/* File size */
+)
+{
+	FATFS *fs = FatFs;
+
+
+	fs->org_clust = sclust;				/* File start cluster */
+	fs->fsize = size;					/* File size */
+	fs->fptr = 0;						/* File pointer */
+#if PF_CLUST_CACHE
+	fs->cc_n = 0;
+	if (fs->org_clust && cache_fill(fs->org_clust) != FR_OK) return FR_DISK_ERR;	/* Load the cluster chain */
+#endif
+	if (check_contig() != FR_OK) return FR_DISK_ERR;	/* Contiguous file? */
+#if PF_USE_LSEEK
+	fs->cltbl = 0;						/* No link map */
+#endif
+	fs->flag |= FA_OPENED;
+
+	return FR_OK;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Open or Create a File                                                 */
 /*-----------------------------------------------------------------------*/
@@ -908,18 +1144,44 @@ FRESULT pf_open (
 
 	if (!fs) return FR_NOT_ENABLED;		/* Check file system */
 
+#if USE_MULTI_BLOCK_READ
+	if (fs->flag & FA_OPENED) disk_stop_read();	/* Leave the stream of the previous file */
+#endif
 	fs->flag = 0;
 	dj.fn = sp;
 	res = follow_path(&dj, dir, path);	/* Follow the file path */
 	if (res != FR_OK) return res;		/* Follow failed */
 	if (!dir[0] || (dir[DIR_Attr] & AM_DIR)) return FR_NO_FILE;	/* It is a directory */
 
-	fs->org_clust = get_clust(dir);		/* File start cluster */
-	fs->fsize = ld_dword(dir+DIR_FileSize);	/* File size */
-	fs->fptr = 0;						/* File pointer */
-	fs->flag = FA_OPENED;
+	return open_file(get_clust(dir), ld_dword(dir+DIR_FileSize));
+}
 
-	return FR_OK;
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Open a File by its Start Cluster                                      */
+/*-----------------------------------------------------------------------*/
+/* No directory is searched, the location comes from an earlier pf_open()
+   (fs->org_clust and fs->fsize) or from an index file */
+
+FRESULT pf_openclust (
+	CLUST sclust,	/* File start cluster (0:Empty file) */
+	DWORD size		/* File size */
+)
+{
+	FATFS *fs = FatFs;
+
+
+	if (!fs) return FR_NOT_ENABLED;		/* Check file system */
+
+#if USE_MULTI_BLOCK_READ
+	if (fs->flag & FA_OPENED) disk_stop_read();	/* Leave the stream of the previous file */
+#endif
+	fs->flag = 0;
+	if (sclust == 1 || sclust >= fs->n_fatent || (!sclust && size)) return FR_NO_FILE;	/* Check the cluster */
+
+	return open_file(sclust, size);
 }
 
 
@@ -930,6 +1192,43 @@ FRESULT pf_open (
 /*-----------------------------------------------------------------------*/
 #if PF_USE_READ
 
+static FRESULT read_sect (void)	/* Get the sector of the file pointer, on a sector boundary */
+{
+	CLUST clst;
+	DWORD sect;
+	BYTE cs;
+	FATFS *fs = FatFs;
+
+
+	if (fs->flag & FA_CONTIG) {						/* Contiguous file? */
+		fs->dsect = fs->org_sect + fs->fptr / 512;	/* Direct sector addressing, no FAT access */
+		return FR_OK;
+	}
+	cs = (BYTE)(fs->fptr / 512 & (fs->csize - 1));	/* Sector offset in the cluster */
+	if (!cs) {										/* On the cluster boundary? */
+		if (fs->fptr == 0) {						/* On the top of the file? */
+			clst = fs->org_clust;
+#if PF_CLUST_CACHE
+			if (!cache_seek(clst) && cache_fill(clst) != FR_OK) return FR_DISK_ERR;
+#endif
+		} else {
+#if PF_CLUST_CACHE
+			clst = next_clust(fs->curr_clust);		/* Follow the cached runs */
+#else
+			clst = get_fat(fs->curr_clust);
+#endif
+		}
+		if (clst <= 1) return FR_DISK_ERR;
+		fs->curr_clust = clst;						/* Update current cluster */
+	}
+	sect = clust2sect(fs->curr_clust);				/* Get current sector */
+	if (!sect) return FR_DISK_ERR;
+	fs->dsect = sect + cs;
+
+	return FR_OK;
+}
+
+
 FRESULT pf_read (
 	void* buff,		/* Pointer to the read buffer (NULL:Forward data to the stream)*/
 	UINT btr,		/* Number of bytes to read */
@@ -937,36 +1236,22 @@ FRESULT pf_read (
 )
 {
 	DRESULT dr;
-	CLUST clst;
-	DWORD sect, remain;
+	DWORD remain;
 	UINT rcnt;
-	BYTE cs, *rbuff = buff;
+	BYTE *rbuff = buff;
 	FATFS *fs = FatFs;
 
 
 	*br = 0;
 	if (!fs) return FR_NOT_ENABLED;		/* Check file system */
 	if (!(fs->flag & FA_OPENED)) return FR_NOT_OPENED;	/* Check if opened */
+	fs->flag &= (BYTE)~FA_SECT;
 
 	remain = fs->fsize - fs->fptr;
 	if (btr > remain) btr = (UINT)remain;			/* Truncate btr by remaining bytes */
 
 	while (btr)	{									/* Repeat until all data transferred */
-		if ((fs->fptr % 512) == 0) {				/* On the sector boundary? */
-			cs = (BYTE)(fs->fptr / 512 & (fs->csize - 1));	/* Sector offset in the cluster */
-			if (!cs) {								/* On the cluster boundary? */
-				if (fs->fptr == 0) {				/* On the top of the file? */
-					clst = fs->org_clust;
-				} else {
-					clst = get_fat(fs->curr_clust);
-				}
-				if (clst <= 1) ABORT(FR_DISK_ERR);
-				fs->curr_clust = clst;				/* Update current cluster */
-			}
-			sect = clust2sect(fs->curr_clust);		/* Get current sector */
-			if (!sect) ABORT(FR_DISK_ERR);
-			fs->dsect = sect + cs;
-		}
+		if ((fs->fptr % 512) == 0 && read_sect() != FR_OK) ABORT(FR_DISK_ERR);	/* On the sector boundary? */
 		rcnt = 512 - (UINT)fs->fptr % 512;			/* Get partial sector data from sector buffer */
 		if (rcnt > btr) rcnt = btr;
 		dr = disk_readp(rbuff, fs->dsect, (UINT)fs->fptr % 512, rcnt);
@@ -978,6 +1263,114 @@ FRESULT pf_read (
 
 	return FR_OK;
 }
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read File up to the Sector End                                        */
+/*-----------------------------------------------------------------------*/
+/* Sequential reads of a stream : the sector of the file pointer and the
+   sectors left in its cluster are kept from a call to the next and
+   stepped when a sector is completed, so that no position is computed
+   from fptr. When a cluster is completed the state is dropped, curr_clust
+   staying on it as every other read path expects, and the next call
+   follows the chain. Any other access to the file pointer drops this
+   state, it is loaded again once. */
+
+static FRESULT sect_sync (void)	/* Load the sector state of the file pointer */
+{
+	FATFS *fs = FatFs;
+
+
+	if (((UINT)fs->fptr % 512) == 0 && read_sect() != FR_OK) return FR_DISK_ERR;	/* On the sector boundary? */
+	fs->csect = (BYTE)(fs->csize - 1 - (fs->fptr / 512 & (fs->csize - 1)));
+	fs->flag |= FA_SECT;
+
+	return FR_OK;
+}
+
+
+FRESULT pf_readsect (
+	void* buff,		/* Pointer to the read buffer (NULL:Forward data to the stream) */
+	UINT btr,		/* Number of bytes to read, truncated at the end of the current sector */
+	UINT* br		/* Pointer to number of bytes read */
+)
+{
+	UINT ofs;
+	FATFS *fs = FatFs;
+
+
+	*br = 0;
+	if (!fs) return FR_NOT_ENABLED;		/* Check file system */
+	if (!(fs->flag & FA_OPENED)) return FR_NOT_OPENED;	/* Check if opened */
+
+	if (btr > fs->fsize - fs->fptr) btr = (UINT)(fs->fsize - fs->fptr);	/* Truncate btr by remaining bytes */
+	if (!btr) return FR_OK;
+	if (!(fs->flag & FA_SECT) && sect_sync() != FR_OK) ABORT(FR_DISK_ERR);
+
+	ofs = (UINT)fs->fptr % 512;
+	if (btr > 512 - ofs) btr = 512 - ofs;			/* Only the current sector is read */
+	if (disk_readp(buff, fs->dsect, ofs, btr)) ABORT(FR_DISK_ERR);
+	fs->fptr += btr;
+	*br = btr;
+
+	if (ofs + btr == 512) {							/* Sector completed, step to the next one */
+		if (fs->flag & FA_CONTIG) {
+			fs->dsect++;
+		} else if (fs->csect) {
+			fs->dsect++;
+			fs->csect--;
+		} else {									/* Cluster completed, followed by the next call */
+			fs->flag &= (BYTE)~FA_SECT;
+		}
+	}
+
+	return FR_OK;
+}
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read File in the Background                                           */
+/*-----------------------------------------------------------------------*/
+#if PF_USE_READ && PF_USE_ASYNC
+
+FRESULT pf_readstart (
+	void* buff,		/* Pointer to the read buffer, not to be used until pf_readbusy() returns 0 */
+	UINT btr,		/* Number of bytes to read, truncated at the end of the current sector */
+	UINT* br		/* Pointer to number of bytes to be read */
+)
+{
+	DWORD remain;
+	UINT rcnt;
+	FATFS *fs = FatFs;
+
+
+	*br = 0;
+	if (!fs) return FR_NOT_ENABLED;		/* Check file system */
+	if (!(fs->flag & FA_OPENED)) return FR_NOT_OPENED;	/* Check if opened */
+	fs->flag &= (BYTE)~FA_SECT;
+
+	remain = fs->fsize - fs->fptr;
+	if (btr > remain) btr = (UINT)remain;			/* Truncate btr by remaining bytes */
+	if (!btr) return FR_OK;
+
+	if ((fs->fptr % 512) == 0 && read_sect() != FR_OK) ABORT(FR_DISK_ERR);	/* On the sector boundary? */
+	rcnt = 512 - (UINT)fs->fptr % 512;				/* Only the current sector is read */
+	if (rcnt > btr) rcnt = btr;
+	if (disk_readp_start(buff, fs->dsect, (UINT)fs->fptr % 512, rcnt)) ABORT(FR_DISK_ERR);
+	fs->fptr += rcnt;								/* The file read pointer is advanced at once */
+	*br = rcnt;
+
+	return FR_OK;
+}
+
+
+BYTE pf_readbusy (void)	/* 1:The background read is in progress */
+{
+	return disk_readp_busy();
+}
 #endif
 
 
@@ -1004,6 +1397,7 @@ FRESULT pf_write (
 	*bw = 0;
 	if (!fs) return FR_NOT_ENABLED;		/* Check file system */
 	if (!(fs->flag & FA_OPENED)) return FR_NOT_OPENED;	/* Check if opened */
+	fs->flag &= (BYTE)~FA_SECT;
 
 	if (!btw) {		/* Finalize request */
 		if ((fs->flag & FA__WIP) && disk_writep(0, 0)) ABORT(FR_DISK_ERR);
@@ -1018,7 +1412,11 @@ FRESULT pf_write (
 	if (btw > remain) btw = (UINT)remain;			/* Truncate btw by remaining bytes */
 
 	while (btw)	{									/* Repeat until all data transferred */
-		if ((UINT)fs->fptr % 512 == 0) {			/* On the sector boundary? */
+		if ((UINT)fs->fptr % 512 == 0 && (fs->flag & FA_CONTIG)) {	/* On the sector boundary of a contiguous file? */
+			fs->dsect = fs->org_sect + fs->fptr / 512;	/* Direct sector addressing, no FAT access */
+			if (disk_writep(0, fs->dsect)) ABORT(FR_DISK_ERR);	/* Initiate a sector write operation */
+			fs->flag |= FA__WIP;
+		} else if ((UINT)fs->fptr % 512 == 0) {		/* On the sector boundary? */
 			cs = (BYTE)(fs->fptr / 512 & (fs->csize - 1));	/* Sector offset in the cluster */
 			if (!cs) {								/* On the cluster boundary? */
 				if (fs->fptr == 0) {				/* On the top of the file? */
@@ -1062,38 +1460,111 @@ FRESULT pf_lseek (
 )
 {
 	CLUST clst;
-	DWORD bcs, sect, ifptr;
+	DWORD bcs, sect, ifptr, *tbl;
 	FATFS *fs = FatFs;
 
 
 	if (!fs) return FR_NOT_ENABLED;		/* Check file system */
 	if (!(fs->flag & FA_OPENED)) return FR_NOT_OPENED;	/* Check if opened */
 
+	fs->flag &= (BYTE)~FA_SECT;
 	if (ofs > fs->fsize) ofs = fs->fsize;	/* Clip offset with the file size */
 	ifptr = fs->fptr;
 	fs->fptr = 0;
 	if (ofs > 0) {
-		bcs = (DWORD)fs->csize * 512;		/* Cluster size (byte) */
-		if (ifptr > 0 &&
-			(ofs - 1) / bcs >= (ifptr - 1) / bcs) {	/* When seek to same or following cluster, */
-			fs->fptr = (ifptr - 1) & ~(bcs - 1);	/* start from the current cluster */
-			ofs -= fs->fptr;
-			clst = fs->curr_clust;
-		} else {							/* When seek to back cluster, */
-			clst = fs->org_clust;			/* start from the first cluster */
-			fs->curr_clust = clst;
+		if (fs->flag & FA_CONTIG) {			/* Contiguous file, the sector is computed */
+			fs->fptr = ofs;
+			fs->dsect = fs->org_sect + ofs / 512;
+			return FR_OK;
 		}
-		while (ofs > bcs) {				/* Cluster following loop */
-			clst = get_fat(clst);		/* Follow cluster chain */
-			if (clst <= 1 || clst >= fs->n_fatent) ABORT(FR_DISK_ERR);
+		bcs = (DWORD)fs->csize * 512;		/* Cluster size (byte) */
+		if (fs->cltbl) {					/* Find the cluster in the link map */
+			tbl = fs->cltbl + 1;
+			ifptr = (ofs - 1) / bcs;		/* Cluster index of the new position */
+			for (;;) {
+				if (!tbl[0]) ABORT(FR_DISK_ERR);	/* Out of the map */
+				if (ifptr < tbl[0]) break;
+				ifptr -= tbl[0];			/* Next fragment */
+				tbl += 2;
+			}
+			clst = (CLUST)(tbl[1] + ifptr);
 			fs->curr_clust = clst;
-			fs->fptr += bcs;
-			ofs -= bcs;
+			fs->fptr = ofs;
+		} else {
+			if (ifptr > 0 &&
+				(ofs - 1) / bcs >= (ifptr - 1) / bcs) {	/* When seek to same or following cluster, */
+				fs->fptr = (ifptr - 1) & ~(bcs - 1);	/* start from the current cluster */
+				ofs -= fs->fptr;
+				clst = fs->curr_clust;
+			} else {							/* When seek to back cluster, */
+				clst = fs->org_clust;			/* start from the first cluster */
+				fs->curr_clust = clst;
+			}
+			while (ofs > bcs) {				/* Cluster following loop */
+				clst = get_fat(clst);		/* Follow cluster chain */
+				if (clst <= 1 || clst >= fs->n_fatent) ABORT(FR_DISK_ERR);
+				fs->curr_clust = clst;
+				fs->fptr += bcs;
+				ofs -= bcs;
+			}
+			fs->fptr += ofs;
 		}
-		fs->fptr += ofs;
 		sect = clust2sect(clst);		/* Current sector */
 		if (!sect) ABORT(FR_DISK_ERR);
 		fs->dsect = sect + (fs->fptr / 512 & (fs->csize - 1));
+#if PF_CLUST_CACHE
+		cache_seek(clst);				/* Follow the cached runs from the new cluster */
+#endif
+	}
+
+	return FR_OK;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Create the Cluster Link Map of the File                               */
+/*-----------------------------------------------------------------------*/
+
+FRESULT pf_linkmap (
+	DWORD* tbl		/* Link map table, tbl[0]:Number of items (in), items used or needed (out) */
+)
+{
+	CLUST clst, nxt;
+	DWORD n, len, *p;
+	FATFS *fs = FatFs;
+
+
+	if (!fs) return FR_NOT_ENABLED;		/* Check file system */
+	if (!(fs->flag & FA_OPENED)) return FR_NOT_OPENED;	/* Check if opened */
+
+	fs->cltbl = 0;
+	n = 2;								/* Table size item and terminator */
+	p = tbl + 1;
+	clst = fs->org_clust;
+	while (clst) {						/* Store the fragments {length, start cluster} */
+		len = 1;
+		while ((nxt = get_fat(clst + len - 1)) == clst + len) len++;	/* Length of the fragment */
+		if (nxt <= 1) return FR_DISK_ERR;
+		n += 2;
+		if (n <= tbl[0]) {
+			*p++ = len;
+			*p++ = clst;
+		}
+		clst = (nxt < fs->n_fatent) ? nxt : 0;	/* Next fragment or end of chain */
+	}
+	if (n > tbl[0]) {					/* The table is too small */
+		tbl[0] = n;
+		return FR_NOT_ENOUGH_CORE;
+	}
+	*p = 0;								/* Terminator */
+	tbl[0] = n;
+	fs->cltbl = tbl;
+	if (n == 4 && !(fs->flag & FA_CONTIG)) {	/* A single fragment, found contiguous now if the walk at open was cut short */
+		fs->org_sect = clust2sect(fs->org_clust);
+		if (!fs->org_sect) return FR_DISK_ERR;
+		fs->flag |= FA_CONTIG;
 	}
 
 	return FR_OK;
@@ -1176,5 +1647,22 @@ FRESULT pf_readdir (
 	return res;
 }
 
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Open a File from a Directory Item                                     */
+/*-----------------------------------------------------------------------*/
+/* The item was returned by pf_readdir(), the directory is not searched again */
+
+FRESULT pf_openentry (
+	const FILINFO *fno	/* Pointer to the file information of the item */
+)
+{
+	if (!fno->fname[0] || (fno->fattrib & AM_DIR)) return FR_NO_FILE;	/* End of directory or a directory */
+
+	return pf_openclust(fno->fclust, fno->fsize);
+}
+
 #endif /* PF_USE_DIR */
 
@@ -11,14 +11,53 @@
 
 #define	PF_USE_READ		1	/* pf_read() function */
 #define	PF_USE_DIR		1	/* pf_opendir() and pf_readdir() function */
-#define	PF_USE_LSEEK	0	/* pf_lseek() function */
+#define	PF_USE_LSEEK	1	/* pf_lseek() and pf_linkmap() function */
 #define	PF_USE_WRITE	0	/* pf_write() function */
+#ifndef PF_USE_ASYNC
+#define	PF_USE_ASYNC	0	/* pf_readstart() and pf_readbusy() function */
+#endif
+/* PF_USE_ASYNC needs a disk driver able to receive in the background, see
+/  disk_readp_start() in avr_mmcp.c (READ_MULTI_BLOCK streaming required).
+/  The SPI interrupt is taken for every byte, which costs more CPU time than
+/  the polled loop at SCK = F_CPU/2 but leaves the main loop free between
+/  two interrupts.
+*/
 
 #define PF_FS_FAT12		0	/* FAT12 */
 #define PF_FS_FAT16		1	/* FAT16 */
 #define PF_FS_FAT32		1	/* FAT32 */
 
 
+/*---------------------------------------------------------------------------/
+/ Performance Configurations
+/---------------------------------------------------------------------------*/
+
+#define PF_CLUST_CACHE	4	/* Number of cluster runs cached for the open file (0:Disable) */
+/* The file cluster chain is loaded on pf_open() as runs of contiguous clusters
+/  {start cluster, length}, and the following runs are loaded when pf_read()
+/  leaves the last cached one. A mostly contiguous file needs no FAT access
+/  while it is read. Each run takes 4 (FAT16 only) or 8 bytes of RAM in FATFS.
+*/
+
+#define PF_CLUST_WALK	128	/* Max number of FAT links followed at a time to load the cache or check contiguity */
+/* Bounds the FAT access of pf_open() on a long chain (a 30MB file in 4KB
+/  clusters has 7680 links). The rest of the chain is followed while the file
+/  is read, PF_CLUST_WALK links at a time, so only a file of up to
+/  PF_CLUST_WALK + 1 clusters is found contiguous at open and addressed by
+/  sector. A longer contiguous file is switched to it when its first cached
+/  run is extended to the end of the file, or by pf_linkmap().
+*/
+
+#define PF_FAT_WINDOW	32	/* Size of the FAT window in bytes, power of 2 up to 512 (0:Disable) */
+/* A FAT entry is read with the entries following it in the same FAT sector,
+/  up to PF_FAT_WINDOW bytes in a single disk_readp(), and the window is kept
+/  in FATFS. The next links of a chain walk (cluster run cache, contiguity
+/  check, seek, link map, directory) are then found in RAM, about one disk
+/  access per PF_FAT_WINDOW/2 (FAT16) or PF_FAT_WINDOW/4 (FAT32) clusters.
+/  FAT12 entries are still read one by one.
+*/
+
+
 /*---------------------------------------------------------------------------/
 / Locale and Namespace Configurations
 /---------------------------------------------------------------------------*/
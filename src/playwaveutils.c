@@ -15,123 +15,784 @@
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 /* Wave file management
  * and play function
- * valid .wav files are LPCM - 8 bits resolution - mono
+ * valid .wav files are LPCM - 8 or 16 bits resolution - mono or stereo,
+ * IMA ADPCM mono or G.711 mono. 16-bit and stereo frames are converted to
+ * 8-bit mono samples by the refills, ADPCM blocks and G.711 codes are
+ * decoded by them.
  */
 
-static uint8_t buffer0[BUFFER_SIZE];
-static uint8_t buffer1[BUFFER_SIZE];
-static uint8_t* buffers[]={buffer0, buffer1};
-volatile uint8_t    active_buffer = 0, alt_buffer = 1;
-volatile uint16_t   buffer_index = 0, buffer_end = 0, bcnt=0;
+#if ASM_ISR
+/* the indexes live in general purpose I/O registers, read and written
+ * with in/out by the naked interrupt, which leaves SREG untouched.
+ * The ring is 256-byte aligned so that the tail is the low byte of
+ * the sample address.
+ */
+#if RING_SIZE != 256
+#error ASM_ISR needs RING_SIZE 256
+#endif
+uint8_t ring[RING_SIZE] __attribute__((aligned(256)));
+#define ring_head   GPIOR2         /* next byte to write, only written by playback() */
+#define ring_tail   GPIOR1         /* next byte to play, only written by the interrupt */
+#else
+uint8_t ring[RING_SIZE];
+volatile uint8_t ring_head = 0;    /* next byte to write, only written by playback() */
+volatile uint8_t ring_tail = 0;    /* next byte to play, only written by the interrupt */
+#endif
+/* the samples are stored to ring[] before the new head is published :
+ * GPIOR2 or a volatile ring_head don't order the plain stores to ring[]
+ * done before, the compiler could sink them past the head update */
+#define RING_BARRIER()  __asm__ __volatile__("" ::: "memory")
+uint8_t ring_fwd;                   /* next byte forwarded by pf_read(0, ...) */
+#if PF_USE_ASYNC
+static uint8_t ring_pending = 0;   /* bytes being received in the background after ring_head */
+#endif
+static uint8_t stage[STAGE_SIZE];  /* frames to be converted to the ring */
+static uint8_t frame_shift;        /* log2 of the frame size */
+static uint8_t conv;               /* conversion of the frames to 8-bit mono */
+#define CONV_NONE   0       /* 8-bit mono, read in place */
+#define CONV_S16    1       /* 16-bit mono */
+#define CONV_U8X2   2       /* 8-bit stereo */
+#define CONV_S16X2  3       /* 16-bit stereo, CONV_S16 | CONV_U8X2 */
+#define CONV_ADPCM  4       /* IMA ADPCM mono, decoded from the staging buffer */
+#define CONV_G711   5       /* G.711 mono, read in place and expanded by table */
+#define CONV_STAGED(c)  ((c) != CONV_NONE && (c) != CONV_G711)  /* read into the staging buffer */
+#if PF_USE_ASYNC
+#define CONV_LINEAR(c)  1                   /* read to a buffer, up to the wrap point of the ring */
+#else
+#define CONV_LINEAR(c)  CONV_STAGED(c)      /* the others are forwarded around the ring */
+#endif
 
 
-uint32_t load_header (void)    /* 0:Invalid format, 1:I/O error, >=1024:Number of samples */
+WAVINFO wav;
+static uint32_t data_left;          /* bytes of the 'data' chunk not read yet */
+
+#if WAV_USE_ADPCM
+/* IMA ADPCM decoder state, carried from a read to the next within a block */
+static uint16_t adpcm_left;         /* bytes of the current block not read yet, 0 : a header comes next */
+static int16_t adpcm_pred;          /* predicted sample */
+static uint8_t adpcm_index;         /* step table index */
+
+/* step sizes, each one about 1.1 times the previous one */
+static const uint16_t adpcm_steps[ADPCM_INDEX_MAX + 1] PROGMEM = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+/* step index update, by the magnitude bits of a sample */
+static const int8_t adpcm_index_step[8] PROGMEM = {
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+#endif
+
+
+#if WAV_USE_G711
+/* G.711 expansion tables, code to PWM value : the 16-bit linear
+ * value of the code, rounded to 8-bit unsigned
+ */
+static const uint8_t ulaw_table[256] PROGMEM = {
+    0x03, 0x07, 0x0B, 0x0F, 0x13, 0x17, 0x1B, 0x1F, 0x23, 0x27, 0x2B, 0x2F, 0x33, 0x37, 0x3B, 0x3F,
+    0x42, 0x44, 0x46, 0x48, 0x4A, 0x4C, 0x4E, 0x50, 0x52, 0x54, 0x56, 0x58, 0x5A, 0x5C, 0x5E, 0x60,
+    0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F, 0x70,
+    0x71, 0x71, 0x72, 0x72, 0x73, 0x73, 0x74, 0x74, 0x75, 0x75, 0x76, 0x76, 0x77, 0x77, 0x78, 0x78,
+    0x79, 0x79, 0x79, 0x79, 0x7A, 0x7A, 0x7A, 0x7A, 0x7B, 0x7B, 0x7B, 0x7B, 0x7C, 0x7C, 0x7C, 0x7C,
+    0x7D, 0x7D, 0x7D, 0x7D, 0x7D, 0x7D, 0x7D, 0x7D, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E,
+    0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0xFD, 0xF9, 0xF5, 0xF1, 0xED, 0xE9, 0xE5, 0xE1, 0xDD, 0xD9, 0xD5, 0xD1, 0xCD, 0xC9, 0xC5, 0xC1,
+    0xBE, 0xBC, 0xBA, 0xB8, 0xB6, 0xB4, 0xB2, 0xB0, 0xAE, 0xAC, 0xAA, 0xA8, 0xA6, 0xA4, 0xA2, 0xA0,
+    0x9F, 0x9E, 0x9D, 0x9C, 0x9B, 0x9A, 0x99, 0x98, 0x97, 0x96, 0x95, 0x94, 0x93, 0x92, 0x91, 0x90,
+    0x8F, 0x8F, 0x8E, 0x8E, 0x8D, 0x8D, 0x8C, 0x8C, 0x8B, 0x8B, 0x8A, 0x8A, 0x89, 0x89, 0x88, 0x88,
+    0x87, 0x87, 0x87, 0x87, 0x86, 0x86, 0x86, 0x86, 0x85, 0x85, 0x85, 0x85, 0x84, 0x84, 0x84, 0x84,
+    0x83, 0x83, 0x83, 0x83, 0x83, 0x83, 0x83, 0x83, 0x82, 0x82, 0x82, 0x82, 0x82, 0x82, 0x82, 0x82,
+    0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+};
+
+static const uint8_t alaw_table[256] PROGMEM = {
+    0x6B, 0x6C, 0x69, 0x6A, 0x6F, 0x70, 0x6D, 0x6E, 0x63, 0x64, 0x61, 0x62, 0x67, 0x68, 0x65, 0x66,
+    0x75, 0x76, 0x74, 0x75, 0x77, 0x78, 0x76, 0x77, 0x71, 0x72, 0x70, 0x71, 0x73, 0x74, 0x72, 0x73,
+    0x2A, 0x2E, 0x22, 0x26, 0x3A, 0x3E, 0x32, 0x36, 0x0A, 0x0E, 0x02, 0x06, 0x1A, 0x1E, 0x12, 0x16,
+    0x55, 0x57, 0x51, 0x53, 0x5D, 0x5F, 0x59, 0x5B, 0x45, 0x47, 0x41, 0x43, 0x4D, 0x4F, 0x49, 0x4B,
+    0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F,
+    0x7B, 0x7B, 0x7A, 0x7A, 0x7C, 0x7C, 0x7B, 0x7B, 0x79, 0x79, 0x78, 0x78, 0x7A, 0x7A, 0x79, 0x79,
+    0x7D, 0x7D, 0x7D, 0x7D, 0x7E, 0x7E, 0x7E, 0x7E, 0x7C, 0x7C, 0x7C, 0x7C, 0x7D, 0x7D, 0x7D, 0x7D,
+    0x96, 0x95, 0x98, 0x97, 0x92, 0x91, 0x94, 0x93, 0x9E, 0x9D, 0xA0, 0x9F, 0x9A, 0x99, 0x9C, 0x9B,
+    0x8B, 0x8A, 0x8C, 0x8B, 0x89, 0x88, 0x8A, 0x89, 0x8F, 0x8E, 0x90, 0x8F, 0x8D, 0x8C, 0x8E, 0x8D,
+    0xD6, 0xD2, 0xDE, 0xDA, 0xC6, 0xC2, 0xCE, 0xCA, 0xF6, 0xF2, 0xFE, 0xFA, 0xE6, 0xE2, 0xEE, 0xEA,
+    0xAB, 0xA9, 0xAF, 0xAD, 0xA3, 0xA1, 0xA7, 0xA5, 0xBB, 0xB9, 0xBF, 0xBD, 0xB3, 0xB1, 0xB7, 0xB5,
+    0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x82, 0x82, 0x82, 0x82, 0x82, 0x82, 0x82, 0x82,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81,
+    0x85, 0x85, 0x86, 0x86, 0x84, 0x84, 0x85, 0x85, 0x87, 0x87, 0x88, 0x88, 0x86, 0x86, 0x87, 0x87,
+    0x83, 0x83, 0x83, 0x83, 0x82, 0x82, 0x82, 0x82, 0x84, 0x84, 0x84, 0x84, 0x83, 0x83, 0x83, 0x83
+};
+
+static const uint8_t* g711_table;   /* table of the open file */
+#endif
+
+#if PLAY_HEALTH
+/* the interrupt counts the empty ring only while a stream is armed,
+ * the drains at the end of the playlist and before a sample rate
+ * change are not underruns. The counters saturate.
+ */
+static volatile uint16_t health_underruns;
+static PLAYHEALTH health;
+#if ASM_ISR
+#define HEALTH_ARMED        0               /* GPIOR0 bit, sbis in the interrupt, sbi/cbi here */
+#define health_arm()        (GPIOR0 |= (uint8_t)_BV(HEALTH_ARMED))
+#define health_disarm()     (GPIOR0 &= (uint8_t)~_BV(HEALTH_ARMED))
+#else
+static volatile uint8_t health_armed;
+#define health_arm()        (health_armed = 1)
+#define health_disarm()     (health_armed = 0)
+#endif
+#define health_inc(c)       do { if((c) != UINT16_MAX) (c)++; } while(0)
+
+/* underruns counted so far, read out of the interrupt */
+static uint16_t health_underruns_get(void)
+{
+    uint16_t n;
+    uint8_t sreg = SREG;
+
+    cli();
+    n = health_underruns;
+    SREG = sreg;
+    return n;
+}
+#else
+#define health_arm()
+#define health_disarm()
+#define health_inc(c)
+#endif
+
+static uint8_t playing;             /* the timers run, see playback_stream() */
+static CLUST index_clust;           /* location of the playlist index file */
+static DWORD index_size;
+
+
+/* check the format of the track, the timers are left untouched as
+ * the previous track may still be played */
+static uint32_t wav_setup (void)   /* 0:Invalid format, >=1024:Number of samples */
 {
     uint32_t sz, f;
-    uint16_t br;
+#ifdef DEBUG
     char dbgstr[50]="";
+#endif
 
 
-    if (pf_read(buffer0, WAVEFILE_HEADER_SIZE, &br)) return 1;   /* Load file header (40 bytes) */
-    if (br != WAVEFILE_HEADER_SIZE || LD_DWORD( pos(buffer0, FILE_FORMAT) ) != FCC('W','A','V','E')) return 0;
-    /* Get Chunk ID and size */
-    if(LD_DWORD( pos(buffer0, FORMAT_BLOCK_ID) ) != FCC('f','m','t',' ') ) return 0;    /* fmt chunk */
-    sz = LD_DWORD( pos(buffer0, FORMAT_BLOCK_SIZE) );        /* Chunk size */
-    if (sz < 16) return 0;      /* Check chunk size. 16 is for LPCM, more is for uuh..?? */
-    if ( LD_WORD( pos(buffer0,SAMPLE_FORMAT) ) != 1) return 0;   /* Check coding type (LPCM) */
-    if ( LD_WORD( pos(buffer0,NUM_CHANNELS) ) != 1) return 0;   /* Check channels (1/2) */
-    if ( LD_WORD( pos(buffer0,BITS_PER_SAMPLE) ) != 8) return 0;  /* Check resolution (8 bit) */
+    if (wav.channels != 1 && wav.channels != 2) return 0;    /* Check channels (1/2), stereo is downmixed */
+    if (wav.format == WAVE_FORMAT_PCM)  /* Check coding type (LPCM/IMA ADPCM) */
+    {
+        if (wav.bits != 8 && wav.bits != 16) return 0;  /* Check resolution (8/16 bit) */
+    }
+#if WAV_USE_ADPCM
+    else if (wav.format == WAVE_FORMAT_IMA_ADPCM)
+    {
+        if (wav.channels != 1 || wav.bits != 4) return 0;  /* mono, 4 bit */
+        if (wav.block_align <= ADPCM_HEADER_SIZE) return 0;
+    }
+#endif
+#if WAV_USE_G711
+    else if (wav.format == WAVE_FORMAT_MULAW || wav.format == WAVE_FORMAT_ALAW)
+    {
+        if (wav.channels != 1 || wav.bits != 8) return 0;  /* mono, 8 bit */
+    }
+#endif
+    else return 0;
 
-    f = LD_DWORD( pos(buffer0,SAMPLE_FREQUENCY) );    /* Check sampling frequency (8kHz-48kHz) */
+    f = wav.freq;   /* Check sampling frequency (8kHz-44.1kHz) */
 
+#ifdef DEBUG
     ltoa(f, dbgstr, 10);
     dbg("f : "); dbg(dbgstr); dbg("\n");
+#endif
 
     if (f < SAMPLE_FREQ_MIN || f > SAMPLE_FREQ_MAX) return 0;
-    
-    SAMPLE_TIMER_SET_FREQ(f);   /* Set sampling interval */
-    itoa(OCR0A, dbgstr, 10);
-    dbg("OCR0A : "); dbg(dbgstr); dbg("\n");
-    if( LD_DWORD( pos(buffer0,DATA_BLOCK_ID) ) == FCC('d','a','t','a'))     /* 'data' chunk */
+
+    sz = wav.data_size;     /* Number of samples (frames) of the data chunk */
+#if WAV_USE_ADPCM
+    if (wav.format == WAVE_FORMAT_IMA_ADPCM)    /* header sample and two samples per byte of each block */
     {
-        sz = LD_DWORD( pos(buffer0,DATA_BLOCK_SIZE) );
-        if (sz < 1024) return 0; /* Check size - 21ms minimum sound duration */
-        PWM_init();
-        return sz;  /* Start to play */
+        f = sz % wav.block_align;
+        sz = sz / wav.block_align * ((wav.block_align - ADPCM_HEADER_SIZE) * 2U + 1U)
+            + (f >= ADPCM_HEADER_SIZE ? (f - ADPCM_HEADER_SIZE) * 2U + 1U : 0U);
+    }
+    else
+#endif
+    sz /= wav.channels * (wav.bits / 8U);   /* bytes per frame */
+    if (sz < 1024) return 0; /* Check size - 21ms minimum sound duration */
+    return sz;  /* Start to play, the timers are set up by playback_stream() */
+}
+
+/* the file is walked chunk by chunk, unknown chunks (LIST, fact, bext...)
+ * are skipped with pf_lseek() without being loaded. The headers are
+ * loaded to the staging buffer, the ring may still be played.
+ */
+uint32_t load_header (void)    /* 0:Invalid format, 1:I/O error, >=1024:Number of samples */
+{
+    uint32_t sz;
+    UINT br;
+    uint8_t fmt = 0;
+
+
+    if (pf_read(stage, FILE_HEADER_SIZE, &br)) return 1;   /* Load RIFF header (12 bytes) */
+    if (br != FILE_HEADER_SIZE || LD_DWORD( pos(stage, FILE_BLOCK_ID) ) != FCC('R','I','F','F')
+        || LD_DWORD( pos(stage, FILE_FORMAT) ) != FCC('W','A','V','E')) return 0;
+
+    for(;;)
+    {
+        /* Get Chunk ID and size */
+        if (pf_read(stage, CHUNK_HEADER_SIZE, &br)) return 1;
+        if (br != CHUNK_HEADER_SIZE) return 0;  /* no data chunk */
+        sz = LD_DWORD( pos(stage, CHUNK_SIZE) );
+
+        if (LD_DWORD( pos(stage, CHUNK_ID) ) == FCC('d','a','t','a'))   /* 'data' chunk */
+            break;
+
+        if (LD_DWORD( pos(stage, CHUNK_ID) ) == FCC('f','m','t',' '))   /* fmt chunk */
+        {
+            if (sz < FORMAT_SIZE) return 0;     /* Check chunk size */
+            if (pf_read(stage, FORMAT_SIZE, &br)) return 1;
+            if (br != FORMAT_SIZE) return 0;
+            wav.format = LD_WORD( pos(stage,SAMPLE_FORMAT) );
+            wav.channels = LD_WORD( pos(stage,NUM_CHANNELS) );
+            wav.freq = LD_DWORD( pos(stage,SAMPLE_FREQUENCY) );
+            wav.block_align = LD_WORD( pos(stage,BYTE_PER_BLOCK) );
+            wav.bits = LD_WORD( pos(stage,BITS_PER_SAMPLE) );
+            sz -= FORMAT_SIZE;  /* extension left */
+            fmt = 1;
+        }
+
+        if (sz > fs.fsize - fs.fptr) return 0;  /* chunk beyond the end of the file */
+        if (pf_lseek(fs.fptr + sz + (sz & 1))) return 1;   /* skip the chunk and its pad byte */
     }
 
-    return 0;
+    if (!fmt) return 0;     /* the fmt chunk comes first */
+
+    wav.data_ofs = fs.fptr;
+    if (sz > fs.fsize - fs.fptr) sz = fs.fsize - fs.fptr;  /* truncated file */
+    wav.data_size = sz;
+    return wav_setup();
 }
 
-/* audio sample timer interrupt */
-ISR(TIMER0_COMPA_vect)
+/* the index file is opened once by its path, then by its location
+ * between the tracks
+ */
+uint16_t index_open (void)  /* 0:No valid index, else:Number of tracks */
 {
-    uint8_t sreg = SREG;
-    cli();
+    UINT br;
+    uint16_t n;
 
-    if(buffer_index == BUFFER_SIZE)   /* if end of current buffer */
+
+    if (pf_open(INDEX_PATH) != FR_OK) return 0;
+    if (pf_read(stage, INDEX_HEADER_SIZE, &br) || br != INDEX_HEADER_SIZE) return 0;
+    if (LD_DWORD( pos(stage, INDEX_ID) ) != FCC('W','I','D','X')
+        || LD_WORD( pos(stage, INDEX_VER) ) != INDEX_VERSION) return 0;
+    n = LD_WORD( pos(stage, INDEX_COUNT) );
+    if (fs.fsize < INDEX_HEADER_SIZE + (uint32_t)n * TRACK_SIZE) return 0;
+
+    index_clust = fs.org_clust;
+    index_size = fs.fsize;
+    return n;
+}
+
+/* open a track of the index, its name (13 bytes) is stored if name isn't null */
+uint32_t index_load (uint16_t track, char* name)    /* 0:Invalid format, 1:I/O error, >=1024:Number of samples */
+{
+    UINT br;
+    uint8_t i;
+
+
+    if (pf_openclust(index_clust, index_size) != FR_OK) return 1;
+    if (pf_lseek(INDEX_HEADER_SIZE + (uint32_t)track * TRACK_SIZE)) return 1;
+    if (pf_read(stage, TRACK_SIZE, &br) || br != TRACK_SIZE) return 1;
+
+    if (name)
     {
-        /* switch buffers */
-        buffer_end = 1;
-        buffer_index = 0;
-        active_buffer ^= 1;
-        alt_buffer ^=1;
+        for (i = 0; i < 12; i++) name[i] = (char)stage[TRACK_NAME + i];
+        name[12] = '\0';
     }
+    wav.format = LD_WORD( pos(stage, TRACK_FORMAT) );
+    wav.channels = stage[TRACK_CHANNELS];
+    wav.bits = stage[TRACK_BITS];
+    wav.freq = LD_WORD( pos(stage, TRACK_FREQ) );
+    wav.block_align = LD_WORD( pos(stage, TRACK_BLOCK_ALIGN) );
+    wav.data_ofs = LD_DWORD( pos(stage, TRACK_DATA_OFS) );
+    wav.data_size = LD_DWORD( pos(stage, TRACK_DATA_SIZE) );
+
+    /* the file is opened up to the end of its data */
+    if (pf_openclust((CLUST)LD_DWORD( pos(stage, TRACK_CLUST) ), wav.data_ofs + wav.data_size) != FR_OK) return 1;
+    if (pf_read(stage, 4, &br)) return 1;
+    if (br != 4 || LD_DWORD(stage) != FCC('R','I','F','F')) return 0;  /* stale index */
+    return wav_setup();
+}
 
-    SET_PWM_VALUE(buffers[active_buffer][buffer_index++]);
-    bcnt--;
+/* audio sample timer interrupt
+ * on underrun the last sample is held
+ */
+#if ASM_ISR
+/* naked version, r24 and Z only, no SREG save (in, out, ld, sts, cpse
+ * don't change the flags). Cycles, interrupt response and vector jmp
+ * included : 34 when a sample is played, 29 on underrun (32 with
+ * PLAY_HEALTH, 46 when it is counted : SREG is only saved then).
+ * See make isrcycles for the count of the built code.
+ */
+ISR(TIMER1_COMPA_vect, ISR_NAKED)
+{
+    __asm__ __volatile__(
+        "push r24               \n\t"
+        "push r30               \n\t"
+        "push r31               \n\t"
+        "in   r30, %[tail]      \n\t"
+        "in   r31, %[head]      \n\t"
+        "cpse r30, r31          \n\t"    /* ring empty ? */
+        "rjmp 1f                \n\t"
+#if PLAY_HEALTH
+        "rjmp 3f                \n\t"
+#else
+        "rjmp 2f                \n\t"
+#endif
+        "1:                     \n\t"
+        "ldi  r31, hi8(%[ring]) \n\t"    /* Z = &ring[tail] */
+        "ld   r24, Z+           \n\t"    /* only ZL is stored back, it wraps at 256 */
+        "sts  %[pwm], r24       \n\t"
+        "out  %[tail], r30      \n\t"
+        "2:                     \n\t"
+        "pop  r31               \n\t"
+        "pop  r30               \n\t"
+        "pop  r24               \n\t"
+        "reti                   \n\t"
+#if PLAY_HEALTH
+        "3:                     \n\t"    /* out of the sample path */
+        "sbis %[flags], %[armed]\n\t"    /* underrun while streaming ? */
+        "rjmp 2b                \n\t"
+        "in   r24, __SREG__     \n\t"
+        "lds  r30, %[count]     \n\t"
+        "lds  r31, %[count]+1   \n\t"
+        "adiw r30, 1            \n\t"
+        "breq 4f                \n\t"    /* saturated */
+        "sts  %[count]+1, r31   \n\t"
+        "sts  %[count], r30     \n\t"
+        "4:                     \n\t"
+        "out  __SREG__, r24     \n\t"
+        "rjmp 2b                \n\t"
+#endif
+        ::  [tail] "I" (_SFR_IO_ADDR(GPIOR1)),
+            [head] "I" (_SFR_IO_ADDR(GPIOR2)),
+            [pwm]  "n" (_SFR_MEM_ADDR(OCR2B)),
+            [ring] "i" (ring)
+#if PLAY_HEALTH
+            ,
+            [flags] "I" (_SFR_IO_ADDR(GPIOR0)),
+            [armed] "I" (HEALTH_ARMED),
+            [count] "i" (&health_underruns)
+#endif
+    );
+}
+#else
+ISR(TIMER1_COMPA_vect)
+{
+    uint8_t tail = ring_tail;
 
-    SREG = sreg;
+    if(tail != ring_head)
+    {
+        SET_PWM_VALUE(ring[tail]);
+        ring_tail = (uint8_t)((tail + 1) & RING_MASK);
+    }
+#if PLAY_HEALTH
+    else if(health_armed) health_inc(health_underruns);    /* the last sample is held */
+#endif
 }
+#endif
 
-uint8_t playback(void)
+/* 16-bit signed to 8-bit unsigned conversion, the high byte is taken,
+ * after a triangular (TPDF) dither of +-1 output LSB if PCM16_DITHER.
+ * Stereo frames are downmixed first.
+ */
+static void pcm16_to_u8(uint8_t* dst, const uint8_t* src, uint8_t n, uint8_t stereo)
 {
-    FRESULT res;
-    uint16_t br;    /* bytes which have been read */
+#if PCM16_DITHER
+    static uint16_t rnd = 1;
+    int16_t t;
+#endif
+    int16_t v;
 
-    dbg("Entering playback()\n");
+    while(n--)
+    {
+        v = (int16_t)LD_WORD(src);
+        src += 2;
+        if(stereo)
+        {
+            v = (int16_t)((v >> 1) + ((int16_t)LD_WORD(src) >> 1));
+            src += 2;
+        }
+#if PCM16_DITHER
+        rnd ^= (uint16_t)(rnd << 7);    /* xorshift, two 8-bit uniform values */
+        rnd ^= (uint16_t)(rnd >> 9);
+        rnd ^= (uint16_t)(rnd << 8);
+        t = (int16_t)((int8_t)rnd + (int8_t)(rnd >> 8));
 
-    /* initialize fifo read buffer */
-    active_buffer = 0;
-    alt_buffer = 1;
-    buffer_index = 0;
-    buffer_end = 0;
+        if(t > 0 && v > INT16_MAX - t) v = INT16_MAX;
+        else if(t < 0 && v < INT16_MIN - t) v = INT16_MIN;
+        else v = (int16_t)(v + t);
+#endif
+        *dst++ = (uint8_t)(((uint16_t)v >> 8) ^ 0x80);
+    }
+}
 
-    /* go to data and skip sector unaligned part to maximise further reads efficiency */
-    if(pf_read(0, 512 - (fs.fptr + DATA_START_OFFSET)%512, &br) != FR_OK) return 1;
+/* 8-bit unsigned stereo downmix */
+static void u8x2_to_u8(uint8_t* dst, const uint8_t* src, uint8_t n)
+{
+    while(n--)
+    {
+        *dst++ = (uint8_t)(((uint16_t)src[0] + src[1] + 1) >> 1);
+        src += 2;
+    }
+}
 
-    dbg("first FIFO fill in.\n");
+#if WAV_USE_ADPCM
+/* IMA ADPCM block header : the first sample, played as is,
+ * and the step index the block starts from
+ * 0:End of file, 1:Data left, 2:Disk error
+ */
+static uint8_t adpcm_block(uint8_t head)
+{
+    UINT br, n;
 
-    pf_read(buffers[active_buffer], BUFFER_SIZE, &br);
-    bcnt+= br;
-    pf_read(buffers[alt_buffer], BUFFER_SIZE, &br);
-    bcnt+= br;
-    
-    dbg("\nstarting play loop.\n");
+    if(data_left < ADPCM_HEADER_SIZE) return 0;
+    for(br = 0; br < ADPCM_HEADER_SIZE; br += n)    /* the header may span a sector end */
+    {
+        if(pf_readsect(stage + br, ADPCM_HEADER_SIZE - br, &n) != FR_OK) return 2;
+        if(!n) return 0;
+    }
+    data_left -= ADPCM_HEADER_SIZE;
+
+    adpcm_pred = (int16_t)LD_WORD(stage);
+    adpcm_index = stage[2] > ADPCM_INDEX_MAX ? ADPCM_INDEX_MAX : stage[2];
+    adpcm_left = wav.block_align - ADPCM_HEADER_SIZE;
+    ring[head] = (uint8_t)(((uint16_t)adpcm_pred >> 8) ^ 0x80);
+    RING_BARRIER();
+    ring_head = (uint8_t)((head + 1) & RING_MASK);
+    return 1;
+}
 
-    sei();
-    PWM_start();
-    sample_timer_start();
+/* 4-bit IMA ADPCM to 8-bit unsigned, two samples per byte, low nibble
+ * first. The prediction is kept within 16 bits (no 32-bit arithmetic),
+ * the samples are written around the ring from head.
+ */
+static void adpcm_decode(uint8_t head, const uint8_t* src, uint8_t n)
+{
+    int16_t pred = adpcm_pred;
+    int8_t index = (int8_t)adpcm_index;
+    uint16_t step, diff;
+    uint8_t b, nib, k;
 
-    do
+    while(n--)
     {
-        if(buffer_end)
+        b = *src++;
+        for(k = 0; k < 2; k++)
         {
-            buffer_end = 0;
-            res = pf_read(buffers[alt_buffer], BUFFER_SIZE, &br);
-            bcnt = br;
+            nib = b & 0x0F;
+            b >>= 4;
+
+            step = pgm_read_word(&adpcm_steps[index]);
+            diff = step >> 3;
+            if(nib & 4) diff += step;
+            if(nib & 2) diff += step >> 1;
+            if(nib & 1) diff += step >> 2;
+
+            if(nib & 8)     /* sign, saturated to the 16-bit range */
+                pred = diff > (uint16_t)((uint16_t)pred + 0x8000U) ? INT16_MIN : (int16_t)((uint16_t)pred - diff);
+            else
+                pred = diff > (uint16_t)(0x7FFFU - (uint16_t)pred) ? INT16_MAX : (int16_t)((uint16_t)pred + diff);
+
+            index += (int8_t)pgm_read_byte(&adpcm_index_step[nib & 7]);
+            if(index < 0) index = 0;
+            else if(index > ADPCM_INDEX_MAX) index = ADPCM_INDEX_MAX;
+
+            ring[head] = (uint8_t)(((uint16_t)pred >> 8) ^ 0x80);
+            head = (uint8_t)((head + 1) & RING_MASK);
         }
+    }
+    adpcm_pred = pred;
+    adpcm_index = (uint8_t)index;
+}
+#endif
+
+#if WAV_USE_G711
+/* G.711 code to PWM value, in place */
+static void g711_expand(uint8_t* p, uint8_t n)
+{
+    const uint8_t* t = g711_table;
+
+    while(n--)
+    {
+        *p = pgm_read_byte(&t[*p]);
+        p++;
+    }
+}
+#endif
 
-    }while(br == BUFFER_SIZE);
+/* add the frames read to the ring, converted to 8-bit unsigned
+ * mono samples if needed, and publish them to the interrupt.
+ * The whole staging buffer is converted at once, the interleaved
+ * channels are never handled by the interrupt.
+ */
+static void ring_put(uint8_t head, UINT br)
+{
+    uint8_t n = (uint8_t)(br >> frame_shift);
+
+    switch(conv)
+    {
+        case CONV_S16:
+        case CONV_S16X2:
+            pcm16_to_u8(&ring[head], stage, n, conv == CONV_S16X2);
+            PLAYBACK_WORK((uint32_t)n * (conv == CONV_S16X2 ? PCM16X2_CYCLES : PCM16_CYCLES));
+            break;
+        case CONV_U8X2:
+            u8x2_to_u8(&ring[head], stage, n);
+            PLAYBACK_WORK((uint32_t)n * U8X2_CYCLES);
+            break;
+#if WAV_USE_ADPCM
+        case CONV_ADPCM:
+            adpcm_decode(head, stage, n);
+            PLAYBACK_WORK((uint32_t)n * 2 * ADPCM_CYCLES);
+            adpcm_left -= n;
+            n <<= 1;    /* two samples per byte */
+            break;
+#endif
+#if WAV_USE_G711
+        case CONV_G711:
+            if(n > RING_SIZE - head)    /* forwarded around the ring */
+            {
+                g711_expand(&ring[head], (uint8_t)(RING_SIZE - head));
+                g711_expand(ring, (uint8_t)(n - (RING_SIZE - head)));
+            }
+            else g711_expand(&ring[head], n);
+            PLAYBACK_WORK((uint32_t)n * G711_CYCLES);
+            break;
+#endif
+        default:    /* read in place */
+            break;
+    }
+    RING_BARRIER();
+    ring_head = (uint8_t)((head + n) & RING_MASK);
+}
+
+/* top up the ring with the file data if at least min bytes are free.
+ * 8-bit mono and G.711 samples are forwarded around the ring by
+ * pf_read(0, ...), the converted ones and the background reads stop
+ * at its wrap point. A background read is added to the ring once it
+ * is completed.
+ * 0:End of file, 1:Data left, 2:Disk error
+ */
+static uint8_t ring_refill(uint8_t min)
+{
+    uint8_t head;
+    UINT n, to, br;
+#if !PF_USE_ASYNC
+    uint8_t* buff;
+#endif
+
+#if PF_USE_ASYNC
+    if(pf_readbusy()) return 1;
+    ring_put(ring_head, ring_pending);
+    ring_pending = 0;
+#endif
+    if((data_left >> frame_shift) == 0) return 0;     /* a partial frame is not played */
+    head = ring_head;
+    n = (uint8_t)((ring_tail - head - 1) & RING_MASK);  /* free room, in samples */
+    if(!n || n < min) return 1;
+#if WAV_USE_ADPCM
+    if(conv == CONV_ADPCM)
+    {
+        if(!adpcm_left) return adpcm_block(head);
+        n >>= 1;                    /* bytes, the decoder writes around the ring */
+        if(!n) return 1;
+        if(n > adpcm_left) n = adpcm_left;
+    }
+    else
+#endif
+    if(CONV_LINEAR(conv) && n > (UINT)(RING_SIZE - head)) n = (UINT)(RING_SIZE - head);    /* up to the wrap point */
+    if(CONV_STAGED(conv) && n > (UINT)(STAGE_SIZE >> frame_shift)) n = (UINT)(STAGE_SIZE >> frame_shift);
+    if(n > data_left >> frame_shift) n = (UINT)(data_left >> frame_shift);
+    to = (512 - (UINT)(fs.fptr % 512)) >> frame_shift;
+    if(to && n > to) n = to;        /* reads don't span a sector, unless a frame does */
+    n <<= frame_shift;              /* bytes */
+
+#if PF_USE_ASYNC
+    /* the SPI interrupt reads in the background, up to the sector end */
+    if(pf_readstart(CONV_STAGED(conv) ? stage : &ring[head], n, &br) != FR_OK) return 2;
+    ring_pending = (uint8_t)br;
+#else
+    buff = CONV_STAGED(conv) ? stage : 0;
+    ring_fwd = head;    /* pf_read(0, ...) streams the samples to the ring */
+    /* within a sector, the sector state of the stream is kept by pf_readsect() */
+    if((to ? pf_readsect(buff, n, &br) : pf_read(buff, n, &br)) != FR_OK) return 2;
+    ring_put(head, br);
+#endif
+    data_left -= br;
 
+    return br != 0;
+}
+
+/* stream the open file, set up by load_header() or index_load(), to the
+ * ring. The timers are started with the first file and keep running from
+ * a file to the next : the next file is opened and streamed while the
+ * ring drains, the interrupt rolls over to it with no gap (a sample rate
+ * change waits for the ring to be played first). playback_end() drains
+ * the ring and stops them.
+ */
+uint8_t playback_stream(void)
+{
+    uint8_t res;
+    uint16_t top = SAMPLE_TIMER_TOP(wav.freq);
+#ifdef DEBUG
+    char dbgstr[8];
+#endif
+
+    dbg("Entering playback_stream()\n");
+
+    /* go to data, the reads stop at the sector boundaries so that
+     * they are sector aligned after the first one */
+    if(pf_lseek(wav.data_ofs) != FR_OK)
+    {
+        health_inc(health.disk_errors);
+        return 1;
+    }
+    data_left = wav.data_size;
+    conv = (uint8_t)((wav.bits == 16 ? CONV_S16 : CONV_NONE) | (wav.channels == 2 ? CONV_U8X2 : CONV_NONE));
+    frame_shift = (uint8_t)((wav.bits == 16) + (wav.channels == 2));
+#if WAV_USE_ADPCM
+    if(wav.format == WAVE_FORMAT_IMA_ADPCM)
+    {
+        conv = CONV_ADPCM;
+        frame_shift = 0;    /* read by bytes */
+        adpcm_left = 0;
+    }
+#endif
+#if WAV_USE_G711
+    if(wav.format == WAVE_FORMAT_MULAW || wav.format == WAVE_FORMAT_ALAW)
+    {
+        conv = CONV_G711;
+        g711_table = wav.format == WAVE_FORMAT_MULAW ? ulaw_table : alaw_table;
+    }
+#endif
+
+    if(playing && OCR1A != top)
+    {
+        /* new sample rate, the previous file is played out first */
+        health_disarm();
+        while(ring_head != ring_tail)
+            PLAYBACK_IDLE();
+        TCNT1 = 0;
+        OCR1A = top;
+        health_arm();
+    }
+
+    if(!playing)
+    {
+        /* initialize fifo read buffer */
+        ring_head = ring_tail = 0;
+#if PF_USE_ASYNC
+        ring_pending = 0;
+#endif
+        sample_timer_init();
+        OCR1A = top;    /* Set sampling interval */
+        PWM_init();
+#ifdef DEBUG
+        utoa(OCR1A, dbgstr, 10);
+        dbg("OCR1A : "); dbg(dbgstr); dbg("\n");
+#endif
+
+        dbg("first FIFO fill in.\n");
+
+        while((res = ring_refill(1)) == 1 && ((ring_tail - ring_head - 1) & RING_MASK) > 1)
+        {;;}    /* an ADPCM byte needs room for two samples */
+        if(res == 2)
+        {
+            health_inc(health.disk_errors);
+            return 1;
+        }
+
+        dbg("\nstarting play loop.\n");
+
+        sei();
+        PWM_start();
+        sample_timer_start();
+        health_arm();
+        playing = 1;
+    }
+    else res = 1;
+
+    while(res == 1)
+    {
+#if PLAY_HEALTH
+        /* refill time, in Timer1 compare ticks : the samples played
+         * meanwhile and the periods the ring was found empty */
+        uint8_t tail = ring_tail;
+        uint16_t under = health_underruns_get(), ticks;
+        CLUST clst = fs.curr_clust;
+
+        res = ring_refill(REFILL_MIN);
+        ticks = (uint16_t)(((ring_tail - tail) & RING_MASK) + (uint16_t)(health_underruns_get() - under));
+        if(ticks > health.refill_max) health.refill_max = ticks;
+        if(ticks > STALL_TICKS && fs.curr_clust != clst) health_inc(health.stalls);
+#else
+        res = ring_refill(REFILL_MIN);
+#endif
+        PLAYBACK_IDLE();    /* free time for the main loop */
+    }
+    if(res == 2) health_inc(health.disk_errors);
+
+    dbg("exiting playback_stream()\n");
+
+    return res == 2;
+}
+
+void playback_end(void)
+{
     /* wait while FIFO not empty */
-    while(bcnt)
-        {;;}
+    health_disarm();
+    while(ring_head != ring_tail)
+        PLAYBACK_IDLE();
 
     sample_timer_stop();
     PWM_stop();
+    playing = 0;
+}
 
-    dbg("exiting playback()\n");
+#if PLAY_HEALTH
+/* copy the health counters to h, then reset them if clear */
+void playback_health(PLAYHEALTH* h, uint8_t clear)
+{
+    uint8_t sreg = SREG;
+
+    cli();      /* the underruns are counted by the interrupt */
+    health.underruns = health_underruns;
+    if(clear) health_underruns = 0;
+    SREG = sreg;
+
+    *h = health;
+    if(clear)
+    {
+        health.stalls = health.disk_errors = 0;
+        health.refill_max = 0;
+    }
+}
+#endif
+
+uint8_t playback(void)
+{
+    uint8_t res = playback_stream();
 
-    return 0;
-}
\ No newline at end of file
+    playback_end();
+    return res;
+}
@@ -8,32 +8,99 @@
 #ifndef PLAYWAVEUTILS_H
 #define PLAYWAVEUTILS_H
 
+#ifdef __AVR__
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#else
+#include "hostio.h"     /* host build, peripherals are simulated */
+#endif
 #include "pff.h"
 
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 /* Wavefile structuration
+ * a RIFF header followed by chunks, each one made of
+ * a header and its content, padded to an even size
  *      data identifier       offset (in byte)
  */
+/* RIFF header */
 #define FILE_BLOCK_ID       	0x00
 #define FILE_BLOCK_SIZE       	0x04
 #define FILE_FORMAT           	0x08
-#define FORMAT_BLOCK_ID       	0x0C
-#define FORMAT_BLOCK_SIZE      	0x10
-#define SAMPLE_FORMAT         	0x14
-#define NUM_CHANNELS          	0x16
-#define SAMPLE_FREQUENCY      	0x18
-#define BYTE_PER_SEC          	0x1C
-#define BYTE_PER_BLOCK        	0x20
-#define BITS_PER_SAMPLE       	0x22
-#define DATA_BLOCK_ID       	0x24
-#define DATA_BLOCK_SIZE        	0x26
-#define DATA_START_OFFSET		0x28
-
-#define WAVEFILE_HEADER_SIZE  	0x28 /* 40 bytes long */
-#define ID_SIZE               	0x04 /* size of each block Id */
-#define WAVEFILE_FORMAT_ID    	"WAVE"
+#define FILE_HEADER_SIZE      	0x0C
+
+/* chunk header */
+#define CHUNK_ID            	0x00
+#define CHUNK_SIZE          	0x04
+#define CHUNK_HEADER_SIZE   	0x08
+
+/* 'fmt ' chunk content */
+#define SAMPLE_FORMAT         	0x00
+#define NUM_CHANNELS          	0x02
+#define SAMPLE_FREQUENCY      	0x04
+#define BYTE_PER_SEC          	0x08
+#define BYTE_PER_BLOCK        	0x0C
+#define BITS_PER_SAMPLE       	0x0E
+#define FORMAT_SIZE           	0x10 /* 16 bytes for LPCM, extended formats are longer */
+
+/* coding types */
+#define WAVE_FORMAT_PCM         0x0001
+#define WAVE_FORMAT_ALAW        0x0006  /* G.711 A-law, 8-bit codes */
+#define WAVE_FORMAT_MULAW       0x0007  /* G.711 mu-law, 8-bit codes */
+#define WAVE_FORMAT_IMA_ADPCM   0x0011  /* 4-bit, blocks of block_align bytes */
+
+/* IMA ADPCM block : a 4-byte header per channel (first sample, 16-bit,
+ * step index, reserved byte), then 4-bit samples, low nibble first */
+#define ADPCM_HEADER_SIZE       4
+#define ADPCM_INDEX_MAX         88
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+/* Playlist index file structuration
+ * written by host/mkplaylist from the card content, it gives the
+ * location and the format of every track so that they are opened
+ * with pf_openclust(), without directory lookup nor header walk.
+ * It has to be written again once the WAV directory changes.
+ *      data identifier       offset (in byte)
+ */
+#define INDEX_PATH              "PLAYLIST.IDX"
+#define INDEX_VERSION           1
+
+/* header */
+#define INDEX_ID                0x00    /* 'W','I','D','X' */
+#define INDEX_VER               0x04
+#define INDEX_COUNT             0x06    /* number of tracks */
+#define INDEX_HEADER_SIZE       0x08
+
+/* track record */
+#define TRACK_NAME              0x00    /* file name, NUL padded (12 bytes) */
+#define TRACK_CLUST             0x0C    /* start cluster */
+#define TRACK_DATA_OFS          0x10    /* file offset of the 'data' chunk content */
+#define TRACK_DATA_SIZE         0x14    /* size of the 'data' chunk content */
+#define TRACK_FREQ              0x18    /* sample frequency, 16-bit */
+#define TRACK_FORMAT            0x1A    /* coding type */
+#define TRACK_CHANNELS          0x1C    /* 8-bit */
+#define TRACK_BITS              0x1D    /* 8-bit */
+#define TRACK_BLOCK_ALIGN       0x1E
+#define TRACK_SIZE              0x20
+
+/* playback health counters, see playback_health() */
+typedef struct {
+    uint16_t    underruns;      /* sample periods the interrupt found the ring empty while streaming */
+    uint16_t    stalls;         /* refills across a cluster boundary longer than STALL_TICKS */
+    uint16_t    disk_errors;    /* seek and read errors while streaming */
+    uint16_t    refill_max;     /* longest refill, in Timer1 compare ticks (sample periods) */
+} PLAYHEALTH;
+
+/* format of the open .wav file, filled in by load_header() or index_load() */
+typedef struct {
+    uint16_t    format;         /* coding type, WAVE_FORMAT_xxx */
+    uint16_t    channels;
+    uint32_t    freq;           /* sample frequency */
+    uint16_t    block_align;    /* bytes per sample frame, per block for ADPCM */
+    uint16_t    bits;           /* bits per sample */
+    uint32_t    data_ofs;       /* file offset of the 'data' chunk content */
+    uint32_t    data_size;      /* size of the 'data' chunk content, within the file */
+} WAVINFO;
 
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 /* four character compare */
@@ -43,51 +110,85 @@
 #define LD_DWORD(p)			(((uint32_t)*(p+3)<<24)+((uint32_t)*(p+2)<<16)+((uint32_t)*(p+1)<<8)+(uint32_t)*p)
 
 
-/* fifo read buffer setup */
-#define BUFFER_SIZE 128     /* sd card read performs only 512 bytes reads. So 2 buffers of 256 bytes to store data 
-                               and maximise read efficiency */    
+/* fifo read buffer setup
+ * single producer (playback()) / single consumer (sample timer interrupt)
+ * ring buffer with 8-bit indexes, one byte is left unused to tell a full
+ * ring from an empty one
+ */
+#define RING_SIZE   256     /* power of 2, up to 256 */
+#define RING_MASK   (RING_SIZE - 1)
+#define REFILL_MIN  64      /* free bytes needed for a refill, batches the reads */
+
+#define STAGE_SIZE  128     /* bytes read at once when the samples need a conversion */
+#define PCM16_DITHER 1      /* 16-bit samples : 1 -> TPDF dither, 0 -> truncation */
+#define WAV_USE_ADPCM 1     /* IMA ADPCM mono files : 1 -> played, 0 -> rejected (saves the decoder tables) */
+#define WAV_USE_G711  1     /* G.711 mono files : 1 -> played, 0 -> rejected (saves 512 bytes of flash) */
+#define PLAY_HEALTH   1     /* playback health counters : 1 -> kept, see playback_health() */
+#define STALL_TICKS   32    /* a refill across a cluster boundary longer than this, in sample periods, is a stall */
+
+#if (RING_SIZE & RING_MASK) || RING_SIZE > 256
+#error RING_SIZE must be a power of 2 up to 256
+#endif
+
+/* the ring is also the outgoing stream of pf_read(0, ...) : the disk
+ * driver forwards the data bytes to ring[ring_fwd], around the ring
+ * (see FORWARD() in avr_mmcp.c). The refills set ring_fwd to the head
+ * and read no more than the free room.
+ */
+extern uint8_t ring[RING_SIZE];
+extern uint8_t ring_fwd;
+#define RING_FORWARD(idx, d)    (ring[idx] = (d), idx = (uint8_t)((idx + 1) & RING_MASK))
+
+/* sample timer interrupt written in assembly (make asmisr=1),
+ * AVR only, the host build keeps the C version
+ */
+#if !defined(ASM_ISR) || !defined(__AVR__)
+#undef ASM_ISR
+#define ASM_ISR     0
+#endif
 #define pos(buf, offset)    (buf+offset)
 
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  * Audio management
  */
 
-#define SAMPLE_FREQ_MAX             10000UL
+#define SAMPLE_FREQ_MAX             44100UL
 #define SAMPLE_FREQ_MIN             8000UL
-#define SAMPLE_TIMER_SET_FREQ(f)    OCR0A = (uint8_t)(F_CPU/8UL/(uint32_t)(f)-1UL)
+#define SAMPLE_TIMER_TOP(f)         (uint16_t)((F_CPU + (uint32_t)(f)/2UL)/(uint32_t)(f)-1UL)
 
 /* data sampling timer :
- * The lower sample frequency limit is fixed by the maximal 
- * sample timer's period :
- * - (OCR0A_max+1)/F_CPU/8 = 128µs ~> 8kHz
- * The upper limit sample frequency is fixed by the maximal
- * PWM frequency which must by at least 8 times the maximal
- * sample frequency :
- * - F_CPU/256/8 = 8kHz
+ * Timer1 in CTC mode counting @F_CPU, the sample period is
+ * set to the nearest CPU cycle (16MHz : 362 cycles @44.1kHz,
+ * error below 0.15%).
+ * The lower limit is 244Hz ((OCR1A_max+1)/F_CPU), the sample
+ * frequency range is kept to 8kHz - 44.1kHz :
+ * - the PWM frequency, F_CPU/256 = 62.5kHz, stays above the
+ *   sample frequency, so that every sample is output at least once,
+ * - at 44.1kHz the interrupt and the refills take a large part of
+ *   the CPU time, see make bench.
  */
 
 static inline
 void sample_timer_init(void)
 {
-    TCCR0A = (uint8_t)_BV(WGM01);   /* timer CTC mode, mode 2 */
-    TCCR0B = 0;                     /*                        */
-    TIMSK0 = 0;
-    TCNT0 = 0;
+    TCCR1A = 0;                         /* timer CTC mode, mode 4 */
+    TCCR1B = (uint8_t)_BV(WGM12);       /*                        */
+    TIMSK1 = 0;
+    TCNT1 = 0;
 }
 
 static inline
 void sample_timer_start(void)
 {
-    TIMSK0 |= (uint8_t) _BV(OCIE0A);  
-    TCCR0B |= (uint8_t) _BV(CS01);    /* select clock source, 8 prescaling
-                                         sample freq range : ~8kHz - ~16kkHz   */
+    TIMSK1 |= (uint8_t) _BV(OCIE1A);
+    TCCR1B |= (uint8_t) _BV(CS10);      /* select clock source, no prescaling */
 }
 
 static inline
 void sample_timer_stop(void)
 {
-    TCCR0B &= (uint8_t) ~_BV(CS01);
-    TIMSK0 &= (uint8_t) ~_BV(OCIE0A);
+    TCCR1B &= (uint8_t) ~_BV(CS10);
+    TIMSK1 &= (uint8_t) ~_BV(OCIE1A);
 }
 
 /* PWM waveform generation timer
@@ -120,6 +221,29 @@ void PWM_stop(void)
     TCCR2B &= (uint8_t) ~_BV(CS20);
 }
 
+/* busy loops of playback() let the host simulation
+ * advance its clock, and the sample conversions are
+ * charged to it, nothing to do on the target
+ */
+#ifdef __AVR__
+#define PLAYBACK_IDLE()
+#define PLAYBACK_WORK(cycles)
+#else
+#define PLAYBACK_IDLE()             host_idle()
+#define PLAYBACK_WORK(cycles)       host_work(cycles)
+#endif
+
+/* estimated CPU cycles of a frame conversion */
+#if PCM16_DITHER
+#define PCM16_CYCLES                40
+#else
+#define PCM16_CYCLES                8
+#endif
+#define PCM16X2_CYCLES              (PCM16_CYCLES + 12)
+#define U8X2_CYCLES                 10
+#define ADPCM_CYCLES                56      /* per sample, two per byte */
+#define G711_CYCLES                 10
+
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  * playback routine and .wav file 
  * management
@@ -127,8 +251,16 @@ void PWM_stop(void)
 extern FATFS fs;
 extern DIR dir;
 extern FILINFO fno;
+extern WAVINFO wav;
 
 uint32_t load_header(void);
+uint16_t index_open(void);
+uint32_t index_load(uint16_t track, char* name);
 uint8_t playback(void);
+uint8_t playback_stream(void);
+void playback_end(void);
+#if PLAY_HEALTH
+void playback_health(PLAYHEALTH* h, uint8_t clear);
+#endif
 
 #endif
\ No newline at end of file
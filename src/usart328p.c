@@ -1,7 +1,62 @@
 #include "usart328p.h"
+#include "diskio.h"		/* USE_MSPIM */
 
 #ifdef __AVR_ATmega328P__
 
+#if USE_MSPIM
+
+static uint8_t bit_ticks;	/* Timer0 ticks per bit */
+
+void usart_init(const uint32_t baud)
+{
+	SWTX_PORT |= _BV(SWTX);	/* idle high */
+	SWTX_DDR |= _BV(SWTX);
+	//Timer0 free running, clk/8 (clk/64 below F_CPU/2048 bauds)
+	TCCR0A = 0;
+	if(F_CPU/8/baud < 256)
+	{
+		TCCR0B = _BV(CS01);
+		bit_ticks = (uint8_t)(F_CPU/8/baud);
+	}
+	else
+	{
+		TCCR0B = _BV(CS01) | _BV(CS00);
+		bit_ticks = (uint8_t)(F_CPU/64/baud);
+	}
+}
+
+//no receiver
+uint8_t usart_available(void)
+{
+	return 0;
+}
+
+char usart_getchar(void)
+{
+	return '\0';
+}
+
+//to send a char : start bit, 8 data bits LSB first, stop bit
+//the edges are timed from Timer0 : an interrupt delays the next edge by
+//its duration (the sample one, 60 cycles, is 4% of a bit at 9600 bauds)
+//but the following ones stay on time, the delays don't add up
+void usart_putchar(const char c)
+{
+	uint16_t frame = (uint16_t)(((uint16_t)(uint8_t)c << 1) | 0x200);
+	uint8_t i, edge = TCNT0;
+
+	for(i = 0; i < 10; i++)
+	{
+		if(frame & 1) SWTX_PORT |= _BV(SWTX);
+		else SWTX_PORT &= (uint8_t)~_BV(SWTX);
+		frame >>= 1;
+		while((uint8_t)(TCNT0 - edge) < bit_ticks) {;;}
+		edge = (uint8_t)(edge + bit_ticks);
+	}
+}
+
+#else
+
 void usart_init(const uint32_t baud)
 {
 	USART_DDR |= _BV(USART_TX) | _BV(USART_RX);
@@ -42,6 +97,8 @@ void usart_putchar(const char c)
 	UDR0 = (uint8_t)c;//load the character to transmit
 }
 
+#endif
+
 //to send a string
 void usart_puts(const char* s)
 {
@@ -0,0 +1,155 @@
+#-----------------------------------------------------------------------------
+#
+# isrcycles.awk
+#
+# Cycle count of an interrupt routine from the avr-objdump -d listing
+# of the firmware, for the AVRe+ core of the ATmega328P.
+#
+# usage : avr-objdump -d main.elf | awk -v vector=__vector_11 -f isrcycles.awk
+#
+# Every instruction of the routine is listed with its cycle count, then
+# the routine is followed from its entry along every path to a reti :
+# conditional branches and skips are counted as not taken / taken
+# (skipping a two word instruction takes 3 cycles). Each path is given
+# with the taken branches and skips it goes through, and its cycles
+# including the interrupt response and the jmp of the vector table,
+# then the shortest and the longest path. Called routines are not
+# followed, their cycles are missing from the figures (a warning is
+# printed), and a backward branch making a loop stops the count.
+#
+#-----------------------------------------------------------------------------
+
+BEGIN {
+	if(vector == "") vector = "__vector_11"	# TIMER1_COMPA_vect
+	if(maxpaths == "") maxpaths = 32		# paths listed one by one
+
+	# 1 cycle instructions are the default
+	split("push pop ld ldd st std lds sts rjmp adiw sbiw sbi cbi mul muls mulsu fmul fmuls fmulsu ijmp", c2)
+	split("jmp rcall icall lpm", c3)
+	split("call ret reti", c4)
+	for(i in c2) cycles[c2[i]] = 2
+	for(i in c3) cycles[c3[i]] = 3
+	for(i in c4) cycles[c4[i]] = 4
+	response = 4 + 3	# interrupt response, jmp of the vector table
+	n = 0
+}
+
+function hex(s,    v, i, d) {
+	v = 0
+	s = tolower(s)
+	sub(/^[ \t]*(0x)?/, "", s)
+	for(i = 1; i <= length(s); i++)
+	{
+		d = index("0123456789abcdef", substr(s, i, 1))
+		if(!d) break
+		v = v * 16 + d - 1
+	}
+	return v
+}
+
+# cycles of the paths from instruction i to the reti, shortest (lo) and
+# longest (hi), memoized
+function follow(i,    a, t, c, s, l, h, l2, h2) {
+	if(i in lo) return
+	if(i > n) { ended = 1; lo[i] = hi[i] = 0; return }
+	if(busy[i]) { loop = loop " " addr[i]; lo[i] = hi[i] = 0; return }
+	busy[i] = 1
+	a = op[i]
+	c = (a in cycles) ? cycles[a] : 1
+	if(a == "reti" || a == "ret" || a == "ijmp") {
+		if(a == "ijmp") ijmp = 1
+		l = h = c
+	} else if(a == "rjmp" || a == "jmp") {
+		t = target(i)
+		follow(t)
+		l = c + lo[t]; h = c + hi[t]
+	} else if(a ~ /^br/) {
+		t = target(i)
+		follow(i + 1); follow(t)
+		l = 1 + lo[i + 1]; h = 1 + hi[i + 1]
+		if(2 + lo[t] < l) l = 2 + lo[t]
+		if(2 + hi[t] > h) h = 2 + hi[t]
+	} else if(a ~ /^(cpse|sbrc|sbrs|sbic|sbis)$/) {
+		s = (i + 2 <= n) ? 1 + words[i + 1] : 0
+		follow(i + 1); follow(i + 2)
+		l = 1 + lo[i + 1]; h = 1 + hi[i + 1]
+		l2 = s + lo[i + 2]; h2 = s + hi[i + 2]
+		if(l2 < l) l = l2
+		if(h2 > h) h = h2
+	} else {
+		if(a ~ /call$/) calls = 1
+		follow(i + 1)
+		l = c + lo[i + 1]; h = c + hi[i + 1]
+	}
+	busy[i] = 0
+	lo[i] = l; hi[i] = h
+}
+
+# index of the instruction a branch of instruction i goes to
+function target(i,    d, t) {
+	if(arg[i] ~ /^\.[-+]/) d = addr[i] + 2 + substr(arg[i], 2) + 0
+	else d = hex(arg[i])
+	for(t = 1; t <= n; t++) if(addr[t] == d) return t
+	outside = 1
+	return n + 1
+}
+
+# list the paths from instruction i, with the cycles c and the taken
+# branches p so far
+function paths(i, c, p,    a, t) {
+	if(npaths >= maxpaths) { npaths++; return }
+	if(i > n || busy[i]) { npaths++; return }
+	a = op[i]
+	if(a == "reti" || a == "ret" || a == "ijmp") {
+		npaths++
+		printf "%3d  path %d%s\n", c + cycles[a] + response, npaths, p == "" ? ", no branch taken" : ", taken :" p
+		return
+	}
+	busy[i] = 1
+	if(a == "rjmp" || a == "jmp") paths(target(i), c + cycles[a], p)
+	else if(a ~ /^br/) {
+		paths(i + 1, c + 1, p)
+		paths(target(i), c + 2, p " " sprintf("%x", addr[i]))
+	} else if(a ~ /^(cpse|sbrc|sbrs|sbic|sbis)$/) {
+		paths(i + 1, c + 1, p)
+		paths(i + 2, c + 1 + words[i + 1], p " " sprintf("%x", addr[i]))
+	} else paths(i + 1, c + ((a in cycles) ? cycles[a] : 1), p)
+	busy[i] = 0
+}
+
+$0 ~ "<" vector ">:" { inside = 1; next }
+
+inside && /^$/ { inside = 0 }
+
+inside && NF {
+	k = split($0, f, "\t")
+	if(k < 3) next
+	split(f[3], m, " ")
+	n++
+	addr[n] = hex(f[1])
+	words[n] = split(f[2], b, " ") / 2
+	op[n] = m[1]
+	arg[n] = (k > 3) ? f[4] : ""
+	sub(/[ ,;].*/, "", arg[n])
+	c = (op[n] in cycles) ? cycles[op[n]] : 1
+	if(op[n] ~ /^br/ || op[n] ~ /^(cpse|sbrc|sbrs|sbic|sbis)$/) c = "1/2"
+	printf "%3s  %x %s %s\n", c, addr[n], f[3], (k > 3) ? f[4] : ""
+}
+
+END {
+	if(!n)
+	{
+		print "isrcycles : " vector " not found" > "/dev/stderr"
+		exit 1
+	}
+	printf "%3d  interrupt response and vector jmp\n", response
+	follow(1)
+	delete busy
+	paths(1, 0, "")
+	if(npaths > maxpaths) printf "     %d paths, %d listed\n", npaths, maxpaths
+	if(loop != "") print "isrcycles : loop at" loop ", its iterations are not counted" > "/dev/stderr"
+	if(calls) print "isrcycles : called routines are not counted" > "/dev/stderr"
+	if(ijmp || outside || ended) print "isrcycles : a path leaves the routine, it is counted up to there" > "/dev/stderr"
+	printf "%3d  cycles on the shortest path of %s\n", lo[1] + response, vector
+	printf "%3d  cycles on the longest path of %s\n", hi[1] + response, vector
+}
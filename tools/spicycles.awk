@@ -0,0 +1,143 @@
+#-----------------------------------------------------------------------------
+#
+# spicycles.awk
+#
+# Cycles per byte of the polled SPI receive loops, from the avr-objdump -d
+# listing of the firmware, for the AVRe+ core of the ATmega328P.
+#
+# usage : avr-objdump -d main.elf | awk -v routines="disk_readp|rx_block" -f spicycles.awk
+#
+# In the routines listed, every write to SPDR (out 0x2e) which is inside a
+# loop starts a byte. The code following it is run cycle by cycle until
+# the next write to SPDR : SPIF reads as set by an in from SPSR (in 0x2d)
+# done bus cycles or more after the write (SCK = F_CPU/2 : 16 cycles for
+# the 8 bits, plus one for the flag), the other conditional branches are
+# taken backwards and not taken forwards, the loops going on. The time
+# between the two writes is the cost of a byte in the steady state of the
+# loop, the SPIF polling phase included.
+#
+#-----------------------------------------------------------------------------
+
+BEGIN {
+	if(routines == "") routines = "disk_readp"
+	if(bus == "") bus = 17		# cycles from the SPDR write to SPIF seen by in
+
+	split("push pop ld ldd st std lds sts rjmp adiw sbiw sbi cbi mul muls mulsu fmul fmuls fmulsu ijmp", c2)
+	split("jmp rcall icall lpm", c3)
+	split("call ret reti", c4)
+	for(i in c2) cycles[c2[i]] = 2
+	for(i in c3) cycles[c3[i]] = 3
+	for(i in c4) cycles[c4[i]] = 4
+	n = 0
+	found = 0
+}
+
+function hex(s,    v, i, d) {
+	v = 0
+	s = tolower(s)
+	sub(/^[ \t]*(0x)?/, "", s)
+	for(i = 1; i <= length(s); i++)
+	{
+		d = index("0123456789abcdef", substr(s, i, 1))
+		if(!d) break
+		v = v * 16 + d - 1
+	}
+	return v
+}
+
+# index of the instruction a branch of instruction i goes to, 0 : outside
+function target(i,    d, t) {
+	if(arg1[i] ~ /^\.[-+]/) d = addr[i] + 2 + substr(arg1[i], 2) + 0
+	else d = hex(arg1[i])
+	for(t = first[rt[i]]; t <= n && rt[t] == rt[i]; t++) if(addr[t] == d) return t
+	return 0
+}
+
+# run from the SPDR write at instruction w to the next one, the cycles
+# are returned, 0 if none is reached
+function run(w,    i, t, a, c, r, spif, flag, tk, steps) {
+	i = w + 1
+	t = 1
+	for(steps = 0; steps < 1000 && i && i <= n && rt[i] == rt[w]; steps++)
+	{
+		a = op[i]
+		if(a == "out" && hex(arg1[i]) == 46) return t	# SPDR
+		if(a == "ret" || a == "reti") return 0
+		c = (a in cycles) ? cycles[a] : 1
+		if(a == "in")
+		{
+			spif[arg1[i]] = (hex(arg2[i]) == 45 && t >= bus)	# SPSR
+			flag = arg1[i]
+		}
+		else if(a == "tst" || a == "and" || a == "andi" || a == "cpi") flag = arg1[i]
+		if(a ~ /^(sbrs|sbrc)$/)
+		{
+			tk = (arg2[i] == "7" && (arg1[i] in spif)) ? spif[arg1[i]] : 0
+			if(a == "sbrc") tk = !tk
+			t += tk ? 1 + words[i + 1] : 1
+			i += tk ? 2 : 1
+			continue
+		}
+		if(a ~ /^(cpse|sbic|sbis)$/) { t++; i++; continue }	# not skipped
+		if(a == "rjmp" || a == "jmp") { t += c; i = target(i); continue }
+		if(a ~ /^br/)
+		{
+			if((a == "brpl" || a == "brmi") && (flag in spif))
+				tk = (a == "brpl") ? !spif[flag] : spif[flag]
+			else
+				tk = (target(i) && target(i) < i)	# loop branch
+			t += tk ? 2 : 1
+			i = tk ? target(i) : i + 1
+			continue
+		}
+		if(a ~ /call$/) calls = 1
+		t += c
+		i++
+	}
+	return 0
+}
+
+/^[0-9a-fA-F]+ <[^>]+>:$/ {
+	name = $2
+	gsub(/[<>:]/, "", name)
+	inside = (name ~ "^(" routines ")$")
+	if(inside) { first[name] = n + 1; found++ }
+	next
+}
+
+inside && /^$/ { inside = 0 }
+
+inside && NF {
+	k = split($0, f, "\t")
+	if(k < 3) next
+	split(f[3], m, " ")
+	n++
+	rt[n] = name
+	addr[n] = hex(f[1])
+	words[n] = split(f[2], b, " ") / 2
+	op[n] = m[1]
+	a = (k > 3) ? f[4] : ""
+	sub(/[ \t]*;.*/, "", a)
+	split(a, p, /, */)
+	arg1[n] = p[1]
+	arg2[n] = p[2]
+}
+
+END {
+	if(!found)
+	{
+		print "spicycles : " routines " not found" > "/dev/stderr"
+		exit 1
+	}
+	for(w = 1; w <= n; w++)
+	{
+		if(op[w] != "out" || hex(arg1[w]) != 46) continue
+		for(j = w + 1; j <= n && rt[j] == rt[w]; j++)		# in a loop ?
+			if((op[j] ~ /^br/ || op[j] == "rjmp" || op[j] == "jmp") && (t = target(j)) && t <= w) break
+		if(j > n || rt[j] != rt[w]) continue
+		c = run(w)
+		if(c) printf "%3d  cycles per byte, %s : SPDR written at %x\n", c, rt[w], addr[w]
+		else printf "     %s : SPDR written at %x, no next write found\n", rt[w], addr[w]
+	}
+	if(calls) print "spicycles : called routines are not counted" > "/dev/stderr"
+}